@@ -1,84 +1,489 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-
-#define N 20000
-#define T_MAX (2 * N - 3)
-#define TRIES 1
-#define COARSE 2000
-#define PROB 0.5
-#define Q 0
-
-void generateSwaps(int t, int *swaps) {
-    for (int i = 1; i < N; i++) {
-        if ((t + i >= N) && (t - i <= N - 2) && ((t - i + N) % 2 == 0)) {
-            swaps[i-1] = 1;
-        } else {
-            swaps[i-1] = 0;
-        }
+#include <string.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__BMI2__) && (defined(__AVX512F__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+/*
+ USAGE:
+ ./Grothendieck-swaps [--n=N] [--t-max=T] [--tries=K] [--coarse=C] [--prob=P] [--q=Q] [--seed=S]
+                     [--threads=T] [--store-perms] [--check-kernels]
+
+ Defaults: N = 20000, T = 2N-3, K = 1, C = 2000, P = 0.5, Q = 0, S = 1.
+ The sweep kernel is chosen once from P and Q: Q = 0 never tests the reverse swap
+ (a one-sided sorting network), and P = 1/2 takes 64 coins from each random word.
+ Random numbers come from xoshiro256** seeded with S, so a run is reproducible.
+ For Q = 0 the sweep runs in AVX-512 or AVX2 (with BMI2) when compiled with them
+ (e.g. -O2 -march=native); --check-kernels compares it with the scalar sweep and exits.
+ Trials run in parallel when compiled with -fopenmp; trial k uses the k-th 2^128-step
+ substream of the seed, so results do not depend on the thread count. Only the coarse
+ matrices are kept unless --store-perms asks for the full permutations.
+*/
+
+// Run parameters (formerly the N, T_MAX, TRIES, COARSE, PROB and Q macros)
+typedef struct {
+    int n;
+    int t_max;
+    int tries;
+    int coarse;
+    double prob;
+    double q;
+    uint64_t seed;
+    int threads;      // 0: the OpenMP default
+    int store_perms;  // Keep and print every trial's permutation
+    int check_kernels; // Only compare the SIMD and scalar sweeps
+} Params;
+
+// At step t the pair (i-1, i), 1 <= i < n, is active when t + i >= n, t - i <= n - 2 and
+// t - i + n is even: the active pairs are i = first, first + 2, ..., up to n - 1. Returns the
+// 0-based position first - 1 of the first active pair (>= n - 1 when none is active).
+static inline int firstActivePair(int n, int t) {
+    int first = n - t;
+    if (t - n + 2 > first) first = t - n + 2;
+    if (first < 1) first = 1;
+    if ((t - first + n) % 2 != 0) first++;
+    return first - 1;
+}
+
+// xoshiro256** generator with a buffer of fair coins (one word gives 64)
+typedef struct {
+    uint64_t s[4];
+    uint64_t coins;
+    int coin_count;
+} Rng;
+
+static inline uint64_t rotl(const uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rngNext(Rng *rng) {
+    uint64_t *s = rng->s;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+// State from a 64-bit seed through splitmix64 (never all zero)
+void rngSeed(Rng *rng, uint64_t seed) {
+    for (int k = 0; k < 4; k++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        rng->s[k] = z ^ (z >> 31);
     }
+    rng->coins = 0;
+    rng->coin_count = 0;
 }
 
-void applyRandomSwap(int *sigma, int *swaps) {
-    for (int i = 0; i < N - 1; i++) {
-        if (swaps[i] == 1) {
-            int count_swap = 1;
-            if (sigma[i] < sigma[i + 1]  && ((double) rand() / RAND_MAX) < PROB) { // Swap criteria
-                int temp = sigma[i];
-                sigma[i] = sigma[i + 1];
-                sigma[i + 1] = temp;
-                continue;
-            }
-           	if (sigma[i] > sigma[i + 1] && ((double) rand() / RAND_MAX) < PROB * Q ) { // Swap criteria
-                int temp1 = sigma[i];
-                sigma[i] = sigma[i + 1];
-                sigma[i + 1] = temp1;
-                continue;
+// Advance by 2^128 steps: successive jumps give non-overlapping substreams
+void rngJump(Rng *rng) {
+    static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ULL << b)) {
+                s0 ^= rng->s[0];
+                s1 ^= rng->s[1];
+                s2 ^= rng->s[2];
+                s3 ^= rng->s[3];
             }
+            rngNext(rng);
         }
     }
+    rng->s[0] = s0;
+    rng->s[1] = s1;
+    rng->s[2] = s2;
+    rng->s[3] = s3;
+    rng->coins = 0;
+    rng->coin_count = 0;
 }
 
-int main() {
-    srand(time(NULL)); // Seed the random number generator
+static inline int fairCoin(Rng *rng) {
+    if (rng->coin_count == 0) {
+        rng->coins = rngNext(rng);
+        rng->coin_count = 64;
+    }
+    int bit = (int)(rng->coins & 1);
+    rng->coins >>= 1;
+    rng->coin_count--;
+    return bit;
+}
+
+// Bernoulli(p) as an integer compare of 53 random bits: threshold = p * 2^53
+static inline uint64_t coinThreshold(double p) {
+    return (uint64_t)(p * 9007199254740992.0);
+}
 
-    int *sigma = malloc(N * sizeof(int));
-    int *swaps = malloc((N - 1) * sizeof(int));
+static inline int biasedCoin(Rng *rng, uint64_t threshold) {
+    return (rngNext(rng) >> 11) < threshold;
+}
 
-    int **tbl = malloc(TRIES * sizeof(int*));
-    for (int i = 0; i < TRIES; i++) {
-        tbl[i] = malloc(N * sizeof(int));
+// The next k <= 32 fair coins as the low bits of the result, first coin lowest (as fairCoin gives them)
+static inline uint64_t fairCoins(Rng *rng, int k) {
+    uint64_t coins = 0;
+    int have = 0;
+    if (rng->coin_count < k) {
+        coins = rng->coins; // The remaining coin_count coins (consumed bits were shifted out)
+        have = rng->coin_count;
+        rng->coins = rngNext(rng);
+        rng->coin_count = 64;
     }
+    int need = k - have;
+    coins |= (rng->coins & ((1ULL << need) - 1)) << have;
+    rng->coins >>= need;
+    rng->coin_count -= need;
+    return coins;
+}
 
-    for (int trry = 0; trry < TRIES; trry++) {
-        if (trry % 50 == 0) {
-            fprintf(stderr, "%d / %d\n", trry, TRIES);
+// The pair (i, i+1); reverse and fair are constants in every caller, so each wrapper below
+// compiles to a kernel without the branches it does not need
+static inline __attribute__((always_inline))
+void sweepPair(int *sigma, int i, Rng *rng, uint64_t prob, uint64_t prob_q, const int reverse, const int fair) {
+    if (sigma[i] < sigma[i + 1]) {
+        if (fair ? fairCoin(rng) : biasedCoin(rng, prob)) { // Swap criteria
+            int temp = sigma[i];
+            sigma[i] = sigma[i + 1];
+            sigma[i + 1] = temp;
         }
+    } else if (reverse && sigma[i] > sigma[i + 1] && biasedCoin(rng, prob_q)) { // Swap criteria
+        int temp1 = sigma[i];
+        sigma[i] = sigma[i + 1];
+        sigma[i + 1] = temp1;
+    }
+}
+
+// One sweep over the active pairs of step t
+static inline __attribute__((always_inline))
+void sweepKernel(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q, const int reverse, const int fair) {
+    for (int i = firstActivePair(n, t); i < n - 1; i += 2) {
+        sweepPair(sigma, i, rng, prob, prob_q, reverse, fair);
+    }
+}
+
+#if defined(__BMI2__) && defined(__AVX512F__)
+#define SIMD_KERNEL_NAME "avx512"
+#define SIMD_PAIRS 8
+#elif defined(__BMI2__) && defined(__AVX2__)
+#define SIMD_KERNEL_NAME "avx2"
+#define SIMD_PAIRS 4
+#endif
 
-        for (int i = 0; i < N; i++) {
-            sigma[i] = i + 1;
-            // sigma[i] = N-i;
+#ifdef SIMD_KERNEL_NAME
+// Swap bits for the ascending pairs in asc (bit k: pair k of the block), from the same draws
+// in the same order as the scalar sweep: fair coins are deposited into the ascending pairs
+static inline __attribute__((always_inline))
+unsigned int swapBits(Rng *rng, unsigned int asc, uint64_t prob, const int fair) {
+    if (fair) return (unsigned int)_pdep_u64(fairCoins(rng, __builtin_popcount(asc)), asc);
+    unsigned int bits = 0;
+    for (unsigned int m = asc; m; m &= m - 1) {
+        if (biasedCoin(rng, prob)) bits |= m & -m;
+    }
+    return bits;
+}
+
+// One-sided sweep, SIMD_PAIRS pairs per vector: swapping the two lanes of each pair puts
+// sigma[i+1] beside sigma[i], one compare gives the ascending pairs, and a blend with the
+// swapped vector applies the swaps the coins allow
+static inline __attribute__((always_inline))
+void sweepOneSidedSimdKernel(int *sigma, int n, int t, Rng *rng, uint64_t prob, const int fair) {
+    int i = firstActivePair(n, t);
+    for (; i + 2 * SIMD_PAIRS <= n; i += 2 * SIMD_PAIRS) {
+#ifdef __AVX512F__
+        __m512i v = _mm512_loadu_si512((const void *)(sigma + i));
+        __m512i swapped = _mm512_shuffle_epi32(v, _MM_PERM_CDAB);
+        unsigned int asc = _pext_u32(_mm512_cmpgt_epi32_mask(swapped, v), 0x5555);
+        unsigned int bits = swapBits(rng, asc, prob, fair);
+        if (bits) {
+            __mmask16 lanes = (__mmask16)(_pdep_u32(bits, 0x5555) * 3);
+            _mm512_storeu_si512((void *)(sigma + i), _mm512_mask_blend_epi32(lanes, v, swapped));
         }
+#else
+        __m256i v = _mm256_loadu_si256((const __m256i *)(sigma + i));
+        __m256i swapped = _mm256_shuffle_epi32(v, 0xB1);
+        unsigned int gt = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(swapped, v)));
+        unsigned int bits = swapBits(rng, _pext_u32(gt, 0x55), prob, fair);
+        if (bits) {
+            const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+            __m256i lanes = _mm256_set1_epi32((int)(_pdep_u32(bits, 0x55) * 3));
+            __m256i select = _mm256_cmpeq_epi32(_mm256_and_si256(lanes, lane_bits), lane_bits);
+            _mm256_storeu_si256((__m256i *)(sigma + i), _mm256_blendv_epi8(v, swapped, select));
+        }
+#endif
+    }
+    for (; i < n - 1; i += 2) {
+        sweepPair(sigma, i, rng, prob, 0, 0, fair);
+    }
+}
+
+static void sweepOneSidedSimd(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    (void)prob_q; // Kept to match SweepFn; the one-sided sweep has no reverse swaps
+    sweepOneSidedSimdKernel(sigma, n, t, rng, prob, 0);
+}
+
+static void sweepOneSidedFairSimd(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    (void)prob_q; // Kept to match SweepFn; the one-sided sweep has no reverse swaps
+    sweepOneSidedSimdKernel(sigma, n, t, rng, prob, 1);
+}
+#endif
+
+static void sweepOneSided(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    sweepKernel(sigma, n, t, rng, prob, prob_q, 0, 0);
+}
+
+static void sweepOneSidedFair(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    sweepKernel(sigma, n, t, rng, prob, prob_q, 0, 1);
+}
+
+static void sweepGeneral(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    sweepKernel(sigma, n, t, rng, prob, prob_q, 1, 0);
+}
 
-        for (int t = 1; t <= T_MAX; t++) {
-            generateSwaps(t, swaps);
-            // printf("\nSwaps: ");
-            // for (int i = 0; i < N - 1; i++) {
-            //     printf("%d ", swaps[i]);
-            // }
-            applyRandomSwap(sigma, swaps);
+static void sweepGeneralFair(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q) {
+    sweepKernel(sigma, n, t, rng, prob, prob_q, 1, 1);
+}
+
+typedef void (*SweepFn)(int *sigma, int n, int t, Rng *rng, uint64_t prob, uint64_t prob_q);
+
+SweepFn selectSweep(const Params *params, const char **name) {
+    int reverse = params->q != 0.0;
+    int fair = params->prob == 0.5;
+    *name = reverse ? (fair ? "general q, fair coins" : "general q")
+                    : (fair ? "q = 0, fair coins" : "q = 0");
+    if (reverse) return fair ? sweepGeneralFair : sweepGeneral;
+#ifdef SIMD_KERNEL_NAME
+    *name = fair ? "q = 0, fair coins, " SIMD_KERNEL_NAME : "q = 0, " SIMD_KERNEL_NAME;
+    return fair ? sweepOneSidedFairSimd : sweepOneSidedSimd;
+#else
+    return fair ? sweepOneSidedFair : sweepOneSided;
+#endif
+}
+
+// Run the SIMD and scalar one-sided sweeps from the same permutation and random stream over whole
+// schedules, for many sizes, seeds and probabilities; any difference in sigma or in the generator
+// state is reported. Returns 1 if all agree (or there is no SIMD kernel).
+// Same generator state; compared field by field, as the struct's tail padding is never written
+static int rngEqual(const Rng *a, const Rng *b) {
+    return memcmp(a->s, b->s, sizeof(a->s)) == 0 && a->coins == b->coins && a->coin_count == b->coin_count;
+}
+
+int checkKernels(void) {
+#ifdef SIMD_KERNEL_NAME
+    static const int sizes[] = {2, 3, 4, 5, 7, 15, 16, 17, 18, 31, 32, 33, 34, 63, 64, 65, 100, 257, 1000, 1001};
+    static const double probs[] = {0.5, 0.3, 0.9, 1.0, 0.0};
+    int checked = 0, failures = 0;
+    for (size_t a = 0; a < sizeof(sizes) / sizeof(sizes[0]); a++) {
+        int n = sizes[a];
+        int *simd = malloc(n * sizeof(int));
+        int *scalar = malloc(n * sizeof(int));
+        for (size_t b = 0; b < sizeof(probs) / sizeof(probs[0]); b++) {
+            for (uint64_t seed = 1; seed <= 4; seed++) {
+                Rng rng_simd, rng_scalar;
+                rngSeed(&rng_simd, seed);
+                rngSeed(&rng_scalar, seed);
+                for (int i = 0; i < n; i++) simd[i] = scalar[i] = (seed % 2) ? i + 1 : n - i;
+                uint64_t prob = coinThreshold(probs[b]);
+                int fair = probs[b] == 0.5;
+                for (int t = 1; t <= 2 * n + 5; t++) {
+                    if (fair) {
+                        sweepOneSidedFairSimd(simd, n, t, &rng_simd, prob, 0);
+                        sweepOneSidedFair(scalar, n, t, &rng_scalar, prob, 0);
+                    } else {
+                        sweepOneSidedSimd(simd, n, t, &rng_simd, prob, 0);
+                        sweepOneSided(scalar, n, t, &rng_scalar, prob, 0);
+                    }
+                    checked++;
+                    if (memcmp(simd, scalar, n * sizeof(int)) != 0 || !rngEqual(&rng_simd, &rng_scalar)) {
+                        fprintf(stderr, "Mismatch: n = %d, p = %g, seed = %llu, t = %d\n",
+                                n, probs[b], (unsigned long long)seed, t);
+                        failures++;
+                        break;
+                    }
+                }
+            }
         }
+        free(simd);
+        free(scalar);
+    }
+    fprintf(stderr, "%s kernel: %d sweeps checked, %d mismatches\n", SIMD_KERNEL_NAME, checked, failures);
+    return failures == 0;
+#else
+    fprintf(stderr, "No SIMD kernel compiled in (needs AVX2 or AVX-512 with BMI2)\n");
+    return 1;
+#endif
+}
 
-        for (int i = 0; i < N; i++) {
-            tbl[trry][i] = sigma[i];
+void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [--n=N] [--t-max=T] [--tries=K] [--coarse=C] [--prob=P] [--q=Q] [--seed=S] [--threads=T] [--store-perms] [--check-kernels]\n", program);
+    fprintf(stderr, "  --n=N      : permutation size (default 20000)\n");
+    fprintf(stderr, "  --t-max=T  : number of sweeps (default 2N-3)\n");
+    fprintf(stderr, "  --tries=K  : independent runs (default 1)\n");
+    fprintf(stderr, "  --coarse=C : block size of the coarsened matrices (default 2000)\n");
+    fprintf(stderr, "  --prob=P   : probability of sorting an increasing pair (default 0.5)\n");
+    fprintf(stderr, "  --q=Q      : a decreasing pair is swapped with probability P*Q (default 0)\n");
+    fprintf(stderr, "  --seed=S   : seed of the random number generator (default 1)\n");
+    fprintf(stderr, "  --threads=T : run trials on T threads (default: all cores)\n");
+    fprintf(stderr, "  --store-perms : keep and print every trial's full permutation (memory TRIES*N)\n");
+    fprintf(stderr, "  --check-kernels : compare the SIMD and scalar sweeps bit for bit, then exit (other options are ignored)\n");
+}
+
+// Parse the command line into params; returns 0 on an invalid argument
+int parseParams(int argc, char *argv[], Params *params) {
+    params->n = 20000;
+    params->t_max = -1;
+    params->tries = 1;
+    params->coarse = 2000;
+    params->prob = 0.5;
+    params->q = 0;
+    params->seed = 1;
+    params->threads = 0;
+    params->store_perms = 0;
+    params->check_kernels = 0;
+
+    for (int a = 1; a < argc; a++) {
+        char *end = NULL;
+        if (strncmp(argv[a], "--n=", 4) == 0) {
+            params->n = (int)strtol(argv[a] + 4, &end, 10);
+        } else if (strncmp(argv[a], "--t-max=", 8) == 0) {
+            params->t_max = (int)strtol(argv[a] + 8, &end, 10);
+        } else if (strncmp(argv[a], "--tries=", 8) == 0) {
+            params->tries = (int)strtol(argv[a] + 8, &end, 10);
+        } else if (strncmp(argv[a], "--coarse=", 9) == 0) {
+            params->coarse = (int)strtol(argv[a] + 9, &end, 10);
+        } else if (strncmp(argv[a], "--prob=", 7) == 0) {
+            params->prob = strtod(argv[a] + 7, &end);
+        } else if (strncmp(argv[a], "--q=", 4) == 0) {
+            params->q = strtod(argv[a] + 4, &end);
+        } else if (strncmp(argv[a], "--seed=", 7) == 0) {
+            params->seed = strtoull(argv[a] + 7, &end, 10);
+        } else if (strncmp(argv[a], "--threads=", 10) == 0) {
+            params->threads = (int)strtol(argv[a] + 10, &end, 10);
+        } else if (strcmp(argv[a], "--store-perms") == 0) {
+            params->store_perms = 1;
+            end = "";
+        } else if (strcmp(argv[a], "--check-kernels") == 0) {
+            params->check_kernels = 1;
+            end = "";
+        }
+        if (!end || *end != '\0') {
+            fprintf(stderr, "Invalid argument '%s'\n", argv[a]);
+            return 0;
+        }
+    }
+    if (params->t_max < 0) params->t_max = 2 * params->n - 3;
+    if (params->n < 2 || params->tries < 1 || params->coarse < 1 || params->coarse > params->n ||
+        params->prob < 0 || params->prob > 1 || params->q < 0 || params->prob * params->q > 1 ||
+        params->threads < 0) {
+        fprintf(stderr, "Invalid parameters: need N >= 2, K >= 1, 1 <= C <= N, 0 <= P <= 1, 0 <= P*Q <= 1\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    Params params;
+    if (!parseParams(argc, argv, &params)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (params.check_kernels) {
+        return checkKernels() ? 0 : 1;
+    }
+    const int N = params.n;
+    const int TRIES = params.tries;
+    const int COARSE = params.coarse;
+
+#ifdef _OPENMP
+    if (params.threads > 0) omp_set_num_threads(params.threads);
+#endif
+
+    const char *kernel_name;
+    SweepFn sweep = selectSweep(&params, &kernel_name);
+    uint64_t prob = coinThreshold(params.prob);
+    uint64_t prob_q = coinThreshold(params.prob * params.q);
+    fprintf(stderr, "N = %d, T = %d, tries = %d, p = %g, q = %g, seed = %llu: %s kernel\n",
+            N, params.t_max, TRIES, params.prob, params.q, (unsigned long long)params.seed, kernel_name);
+
+    // Trial k draws from substream k (the seeded state jumped k times), whichever thread runs it
+    Rng *streams = malloc(TRIES * sizeof(Rng));
+    Rng rng;
+    rngSeed(&rng, params.seed); // Seed the random number generator
+    for (int trry = 0; trry < TRIES; trry++) {
+        streams[trry] = rng;
+        rngJump(&rng);
+    }
+
+    // Per-trial coarse matrices and their sum; full permutations only with --store-perms
+    int nCoarse = N / COARSE; // Size of the coarsened matrix
+    int cells = nCoarse * nCoarse;
+    int *coarse = calloc((size_t)(unsigned int)TRIES * cells, sizeof(int));
+    long long *sumMatrix = calloc(cells, sizeof(long long));
+    int *tbl = params.store_perms ? malloc((size_t)(unsigned int)TRIES * N * sizeof(int)) : NULL;
+    int done = 0;
+
+#pragma omp parallel
+    {
+        int *sigma = malloc(N * sizeof(int));
+        long long *localSum = calloc(cells, sizeof(long long)); // This thread's share of the sum
+
+#pragma omp for schedule(dynamic)
+        for (int trry = 0; trry < TRIES; trry++) {
+            for (int i = 0; i < N; i++) {
+                sigma[i] = i + 1;
+                // sigma[i] = N-i;
+            }
+
+            Rng trial_rng = streams[trry];
+            for (int t = 1; t <= params.t_max; t++) {
+                sweep(sigma, N, t, &trial_rng, prob, prob_q);
+            }
+
+            // Count placements (rows and columns past the last full block are left out)
+            int *coarseMatrix = coarse + (size_t)trry * cells;
+            for (int i = 0; i < N; i++) {
+                int src = (i / COARSE);
+                int dest = ((sigma[i] - 1) / COARSE);
+                if (src < nCoarse && dest < nCoarse) {
+                    coarseMatrix[src * nCoarse + dest]++;
+                    localSum[src * nCoarse + dest]++;
+                }
+            }
+            if (tbl) {
+                memcpy(tbl + (size_t)trry * N, sigma, N * sizeof(int));
+            }
+
+            int finished;
+#pragma omp atomic capture
+            finished = ++done;
+            if (finished % 50 == 1 || TRIES == 1) {
+                fprintf(stderr, "%d / %d\n", finished - 1, TRIES);
+            }
+        }
+
+#pragma omp critical
+        for (int c = 0; c < cells; c++) {
+            sumMatrix[c] += localSum[c];
         }
+        free(localSum);
+        free(sigma);
     }
 
 		printf("{{");  // Begin the outer list
-		for (int trry = 0; trry < TRIES; trry++) {
+		for (int trry = 0; tbl && trry < TRIES; trry++) {
 				printf("{");  // Begin an inner list
 				for (int i = 0; i < N; i++) {
-						printf("%d", tbl[trry][i]);  // Print the element
+						printf("%d", tbl[(size_t)trry * N + i]);  // Print the element
 						if (i < N - 1) {
 								printf(", ");  // Separate elements with a comma
 						}
@@ -90,32 +495,17 @@ int main() {
 		}
 		printf("},");  // End the outer list
 
-
-		int nCoarse = N / COARSE; // Size of the coarsened matrix
 		// Coarsened result
     printf("{"); // Begin the outer list for coarse output
     for (int trry = 0; trry < TRIES; trry++) {
-        // Create and initialize coarsened matrix
-        int coarseMatrix[nCoarse][nCoarse];
-        for (int i = 0; i < nCoarse; i++) {
-            for (int j = 0; j < nCoarse; j++) {
-                coarseMatrix[i][j] = 0;
-            }
-        }
-
-        // Count placements
-        for (int i = 0; i < N; i++) {
-            int src = (i / COARSE);
-            int dest = ((tbl[trry][i] - 1) / COARSE);
-            coarseMatrix[src][dest]++;
-        }
+        int *coarseMatrix = coarse + (size_t)trry * cells;
 
         // Output coarsened matrix
         printf("{");
         for (int i = 0; i < nCoarse; i++) {
             printf("{");
             for (int j = 0; j < nCoarse; j++) {
-                printf("%d", coarseMatrix[i][j]);
+                printf("%d", coarseMatrix[i * nCoarse + j]);
                 if (j < nCoarse - 1)
                     printf(", ");
             }
@@ -127,45 +517,14 @@ int main() {
         if (trry < TRIES - 1)
             printf(", ");
     }
-		/* printf("}}"); // End the outer list for coarse output */
 
 		printf("},{"); // End the outer list for coarse output
 
-		/* Now make one list which is the sum of all the coarsened matrices */
-		int sumMatrix[nCoarse][nCoarse];
-		for (int i = 0; i < nCoarse; i++) {
-				for (int j = 0; j < nCoarse; j++) {
-						sumMatrix[i][j] = 0;
-				}
-		}
-		for (int trry = 0; trry < TRIES; trry++) {
-
-				int coarseMatrix[nCoarse][nCoarse];
-				for (int i = 0; i < nCoarse; i++) {
-						for (int j = 0; j < nCoarse; j++) {
-								coarseMatrix[i][j] = 0;
-						}
-				}
-
-				// Count placements
-				for (int i = 0; i < N; i++) {
-						int src = (i / COARSE);
-						int dest = ((tbl[trry][i] - 1) / COARSE);
-						coarseMatrix[src][dest]++;
-				}
-
-				for (int i = 0; i < nCoarse; i++) {
-						for (int j = 0; j < nCoarse; j++) {
-								sumMatrix[i][j] += coarseMatrix[i][j];
-						}
-				}
-		}
-		//print this sum matrix in Mathematica-readable format
-
+		//print the sum of all the coarsened matrices in Mathematica-readable format
 		for (int i = 0; i < nCoarse; i++) {
 				printf("{");
 				for (int j = 0; j < nCoarse; j++) {
-						printf("%d", sumMatrix[i][j]);
+						printf("%lld", sumMatrix[i * nCoarse + j]);
 						if (j < nCoarse - 1)
 								printf(", ");
 				}
@@ -179,10 +538,10 @@ int main() {
 
 
 
-for(int i = 0; i < TRIES; i++) {
+for(int i = 0; tbl && i < TRIES; i++) {
 		printf("[");
 		for(int j = 0; j < N; j++) {
-				printf("%d", tbl[i][j]);
+				printf("%d", tbl[(size_t)i * N + j]);
 				if(j < N - 1) {
 						printf(", ");
 				}
@@ -193,11 +552,9 @@ for(int i = 0; i < TRIES; i++) {
 		}
 }
     // Free memory
-    free(sigma);
-    free(swaps);
-    for (int i = 0; i < TRIES; i++) {
-        free(tbl[i]);
-    }
+    free(streams);
+    free(coarse);
+    free(sumMatrix);
     free(tbl);
 
 printf("\n");
@@ -9,11 +9,14 @@
 /*
 COMPILE:
 
-clang++ -O3 -march=native -flto -fuse-linker-plugin -funroll-loops -ftree-vectorize -pthread -ffast-math -fopenmp -o heuristic_dim_lambda heuristic_dim_lambda.cpp -lgmp -lgmpxx -I/opt/homebrew/include -L/opt/homebrew/lib
+clang++ -O3 -march=native -flto -fuse-linker-plugin -funroll-loops -ftree-vectorize -pthread -ffast-math -fopenmp -o heuristic_dim_lambda heuristic_dim_lambda.cpp -lmpfr -lgmp -lgmpxx -I/opt/homebrew/include -L/opt/homebrew/lib
 
 USAGE:
 
-./heuristic_dim_lambda <N> [--shake=k] [--stop-window=L] [--recompute=size] [--store-n=M] [--store-n1=K]
+./heuristic_dim_lambda <N> [--shake=k] [--stop-window=L] [--recompute=size] [--store-n=M] [--store-n1=K] [--arena=0|1] [--arena-mb=M]
+                       [--pipeline=0|1] [--shake-prune=R] [--score-cache=PATH] [--score-cache-mb=M]
+                       [--level-budget=S] [--mem-limit=MB] [--history=d] [--store-history=K2,K3,...]
+                       [--select=top|diverse] [--bucket-quota=Q] [--check-kernels=M] [--c-lambda-stream=PATH]
 
 Parameters:
   <N>             : Perform heuristic search up to size N
@@ -23,6 +26,30 @@ Parameters:
   --store-n=M     : Maximum number of top partitions to keep in the pool for size n (default: 100)
   --store-n1=K    : Maximum number of top partitions to keep in the pool for size n-1 (default: 50)
   --store-max=M   : (Legacy) Sets both pool sizes (--store-n=M and --store-n1=M/2)
+  --arena=0|1     : Use the per-thread level arena for partitions and GMP scratch (default: 1)
+  --arena-mb=M    : Address space reserved per thread for the level arena in MB (default: 4096)
+  --pipeline=0|1  : Stream generated candidates straight into evaluation tasks (default: 1);
+                    0 runs the phased generate-then-evaluate loop
+  --shake-prune=R : (Pipeline only) Do not shake a k=0 candidate whose f^lambda is below the current
+                    pool cutoff divided by R (default: 0 = never prune)
+  --score-cache=PATH : Look up and store f^lambda in a persistent cache file shared by concurrent runs
+  --score-cache-mb=M : Size limit of a newly created score cache in MB (default: 1024)
+  --level-budget=S : Adaptive mode: retune pool sizes and shake depth (at most --shake) after every
+                     level so that the next level takes about S seconds
+  --mem-limit=MB   : Adaptive mode: shrink pools and shake depth when resident memory nears MB, and
+                     (without --level-budget) grow them back to --store-n and --shake when it falls again
+  --history=d      : (Pipeline only) Keep the pools of sizes n, n-1, ..., n-d+1 and generate size n+1
+                     candidates from all of them by adding j+1 boxes at depth j (default: 2)
+  --store-history=K2,K3,... : Pool size limits for the depths 2..d-1 (default: store-n1; the last
+                     value given is repeated for deeper pools)
+  --select=top|diverse : Fill the next pool with the top scores, or with the top scores under a
+                     per-shape-bucket quota (buckets: symmetric core size, first row, length) (default: top)
+  --bucket-quota=Q : (Diverse selection) Pool members allowed per shape bucket (default: store-n/8)
+  --check-kernels=M : Cross-check the SIMD, scalar and small-partition kernels and f^lambda on all partitions of
+                     size <= M, then exit (default: off)
+  --c-lambda-stream=PATH : Compute c(lambda) of every level's maximum in-process and append a binary record
+                     (n, c(lambda), partition, position of the digits in heuristic_results.txt) to PATH,
+                     for partition_updater --c-lambda-stream=PATH (default: off)
 */
 
 #include <iostream>
@@ -42,9 +69,32 @@ Parameters:
 #include <mutex>     // For thread-safe caching
 #include <chrono>    // For getting current time
 #include <ctime>     // For time formatting
+#include <atomic>    // For arena slot assignment
+#include <cstdlib>   // For malloc/free fallback of the arena
+#include <cstring>   // For memcpy in arena realloc
+#include <sys/mman.h> // For reserving the arena address range
+#include <deque>     // Per-worker task deques
+#include <functional> // Executor tasks
+#include <memory>    // Shared candidate batches
+#include <thread>    // std::this_thread::yield for idle workers
+#include <cstdint>   // Fixed-width fields of the score cache file
+#include <fcntl.h>   // open() for the score cache
+#include <sys/file.h> // flock() for sharing the score cache between processes
+#include <sys/stat.h> // fstat() for the score cache size
+#include <unistd.h>  // ftruncate/pwrite/close for the score cache
+#include <sys/resource.h> // getrusage() for the adaptive memory ceiling
+#ifdef __GLIBC__
+#include <malloc.h>  // malloc_trim() between levels under a memory ceiling
+#endif
+#include <climits>   // ULONG_MAX for word-sized hook products
+#include <array>     // Fixed-capacity storage of the small-partition kernels
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h> // Vectorized hook kernels
+#endif
 
 // Include GMP C++ interface header
 #include <gmpxx.h>
+#include <mpfr.h>    // c(lambda) of each level, as partition_updater computes it
 
 // --- Configuration & Type Aliases ---
 using std::vector;
@@ -55,10 +105,62 @@ using std::string;
 using std::max;
 using std::min;
 
+// --- Level Arena Allocator ---
+// Every thread owns a slab of one reserved address range. Blocks are carved
+// from the slab by bumping a pointer and recycled through per-thread size-class
+// free lists; the whole arena is rewound in O(1) when an n-level ends.
+// The arena is only active during candidate generation and evaluation, so
+// nothing allocated from it may outlive the level (pools are copied to the
+// heap during selection, while the arena is inactive).
+
+struct LevelArenaStats {
+    unsigned long long requests = 0; // All allocation requests (what malloc saw before the arena)
+    unsigned long long recycled = 0; // Served from a free list
+    unsigned long long bumped = 0;   // Carved fresh from a slab
+    unsigned long long heap = 0;     // Fell through to malloc
+    size_t arena_bytes_used = 0;     // Sum of slab high-water marks
+};
+
+// Reserve slabs of slab_bytes for up to max_threads threads (enabled=false: pass-through to malloc)
+void level_arena_init(bool enabled, size_t slab_bytes, int max_threads);
+// Switch allocation from the arena on/off (call outside parallel regions only)
+void level_arena_set_active(bool active);
+// Rewind all slabs and drop all free lists (call outside parallel regions only); release also
+// returns the pages the level used (and the free heap) to the OS, so resident memory is the next level's
+void level_arena_reset(bool release = false);
+// Sum the per-thread counters and optionally zero them
+LevelArenaStats level_arena_collect_stats(bool clear);
+void* level_arena_allocate(size_t bytes);
+void level_arena_deallocate(void* p, size_t bytes);
+// GMP memory functions routed through the arena (installed via mp_set_memory_functions)
+void* gmp_level_alloc(size_t bytes);
+void* gmp_level_realloc(void* p, size_t old_bytes, size_t new_bytes);
+void gmp_level_free(void* p, size_t bytes);
+
+template <class T>
+struct LevelAllocator {
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    LevelAllocator() noexcept {}
+    template <class U> LevelAllocator(const LevelAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        void* p = level_arena_allocate(n * sizeof(T));
+        if (!p) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t n) noexcept { level_arena_deallocate(p, n * sizeof(T)); }
+};
+template <class T, class U>
+bool operator==(const LevelAllocator<T>&, const LevelAllocator<U>&) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const LevelAllocator<T>&, const LevelAllocator<U>&) noexcept { return false; }
+
 // Type alias for Partition (using unsigned int for parts)
-using Partition = vector<unsigned int>;
+using Partition = vector<unsigned int, LevelAllocator<unsigned int>>;
 // Use a set to store partitions to automatically handle uniqueness and ordering
-using PartitionSet = std::set<Partition>;
+using PartitionSet = std::set<Partition, std::less<Partition>, LevelAllocator<Partition>>;
 
 // GMP Integer type alias
 using BigInt = mpz_class;
@@ -83,6 +185,50 @@ vector<Partition> remove_box(const Partition& lambda);
 // Generate additional candidates by "shaking" (exactly k remove/add steps)
 PartitionSet generate_shaken_candidates(const Partition& lambda_start, int exact_k);
 
+// Union of generate_shaken_candidates over k=1..max_k, computed with a single BFS
+PartitionSet generate_shaken_candidates_upto(const Partition& lambda_start, int max_k);
+
+// --- Pool History ---
+// Pools of the sizes n-2, n-3, ... (pool_n and pool_n_minus_1 stay separate variables).
+// A ring buffer: pushing the outgoing n-1 pool rotates the head instead of moving pools.
+class PoolHistory {
+public:
+    // Keep the pools of depths 2..depth-1 with the given size limits (limits[0] is depth 2)
+    void configure(int depth, const vector<size_t>& limits);
+    // Deepest depth held (1 when there is no history beyond pool_n_minus_1)
+    int deepest() const { return (int)slots_.size() + 1; }
+    // Pool at depth >= 2, i.e. of size n - depth for the level that generates n+1
+    const vector<ScoredPartition>& at(int depth) const { return slots_[slot_index(depth)]; }
+    // The old pool_n_minus_1 enters at depth 2; the deepest pool is dropped
+    void push(vector<ScoredPartition>&& pool);
+    size_t limit(int depth) const { return limits_[depth - 2]; }
+
+private:
+    size_t slot_index(int depth) const { return (head_ + depth - 2) % slots_.size(); }
+    vector<vector<ScoredPartition>> slots_;
+    vector<size_t> limits_;
+    size_t head_ = 0;
+};
+
+// Sort a pool by score (descending) and keep the top `limit`, plus any ties at the cutoff
+void trim_scored_pool(vector<ScoredPartition>& pool, size_t limit);
+
+// --- Diverse Pool Selection ---
+// Pipelined levels keep this many times the pool limit so that the quotas have a choice
+static const size_t DIVERSE_OVERSAMPLE = 4;
+// Coarse shape signature: symmetric core size, first row and number of rows (in steps of ~sqrt(n)/2)
+uint64_t shape_bucket(const Partition& p, unsigned int step);
+// One pass over candidates sorted by score: admit a candidate while its bucket is under quota
+// (maximizers always), then top up from the skipped candidates in score order
+vector<ScoredPartition> select_diverse_pool(const vector<ScoredPartition>& sorted_candidates, int n,
+                                            size_t limit, size_t quota, size_t& buckets_used);
+
+// Generate, deduplicate and evaluate all candidates of size n+1 as one task pipeline.
+// Returns (sorted by score) every candidate scoring at least the pool_limit-th best score.
+void run_pipelined_level(const vector<ScoredPartition>& pool_n, const vector<ScoredPartition>& pool_n_minus_1,
+                         const PoolHistory& history, int n, int max_shake_k, size_t pool_limit,
+                         double shake_prune_ratio, vector<ScoredPartition>& top_candidates);
+
 // Check if a partition is valid (parts are non-increasing and positive)
 bool is_valid_partition(const Partition& p);
 
@@ -95,12 +241,89 @@ void clear_g_prime_cache();
 // Find the largest symmetric subdiagram (base subdiagram) lambda_sym
 Partition get_base_symmetric_subdiagram(const Partition& p);
 
+// Conjugate (transpose) of a valid partition, filled run by run of equal parts
+Partition conjugate_partition(const Partition& p);
+
 // Hook Length Calculation
 long long hookLength(const Partition& partition, int r, int c);
 
+// --- Hook Kernels ---
+// All hooks of row r are lambda[r] - c + lambda'[c] - r - 1 for c < lambda[r]; with the conjugate
+// computed once, a row is one vector expression (AVX-512 or AVX2 when compiled in, else scalar).
+// hooks receives one value per cell, row by row; returns false for an invalid partition.
+bool compute_hooks(const Partition& p, vector<unsigned int>& hooks, bool force_scalar = false);
+// Histogram of the hooks (index = hook length) and log2 f^lambda = log2 n! - sum log2 h
+bool hook_profile(const Partition& p, vector<unsigned int>& hook_hist, double& log2_f, bool force_scalar = false);
+// Name of the compiled-in hook kernel ("avx512", "avx2" or "scalar")
+const char* hook_kernel_name();
+// Compare kernels, hookLength and countSYT_gmp on all partitions of size <= max_size
+bool check_hook_kernels(int max_size);
+
+// --- Small-Partition Kernels ---
+// n! fits in 64 bits up to n = 20 and in 128 bits up to n = 34; below that f^lambda is computed
+// by kernels specialized on a row-capacity bound, with std::array storage and no GMP arithmetic.
+static const unsigned int SMALL_KERNEL_MAX_N_64 = 20;
+static const unsigned int SMALL_KERNEL_MAX_N = 34;
+// Exact f^lambda of a valid partition of size <= SMALL_KERNEL_MAX_N; false when it does not apply
+bool count_syt_small(const Partition& p, BigInt& f);
+
 // Standard Young Tableaux (SYT) Count Calculation (GMP Integer version)
 BigInt countSYT_gmp(const Partition& partition);
 
+// --- Persistent Score Cache (shared across runs and processes) ---
+// Map (or create) the cache file; size_mb bounds a newly created file
+bool score_cache_open(const string& path, long long size_mb);
+// Take the shared file lock for the lookups of one level
+void score_cache_begin_level();
+// Release it, append this level's new scores under the exclusive lock and report hit counts
+void score_cache_end_level();
+bool score_cache_lookup(const Partition& p, BigInt& f);
+void score_cache_record(const Partition& p, const BigInt& f);
+uint64_t partition_cache_hash(const Partition& p);
+// countSYT_gmp behind the score cache, which is keyed by min(lambda, lambda')
+BigInt score_partition(const Partition& p);
+// Number of score_partition calls since the last call
+unsigned long long take_level_scoring_count();
+
+// --- c(lambda) Record Stream ---
+// c(lambda) = -log(f^lambda / sqrt(n!)) / sqrt(n), computed as partition_updater.c's
+// compute_c_lambda_fast does (MPFR, from lngamma(n+1) and the leading bits of f^lambda) and
+// rounded to a double the same way, so the updater stores it unchanged.
+double compute_c_lambda(const BigInt& f, unsigned long n);
+// Open (or append to) the record stream; restart discards the records of an earlier results
+// file, whose positions do not hold in a new or rewritten one. The file starts with the magic "DIMLCLS1", then per level:
+// uint64 n, double c(lambda), uint64 offset and uint64 length of the f^lambda digits in
+// heuristic_results.txt (length 0: not written there), uint32 part count, uint32 0, int32 parts
+// (padded to a multiple of 8 bytes)
+bool c_lambda_stream_open(const string& path, bool restart);
+bool c_lambda_stream_active();
+void c_lambda_stream_write(unsigned long n, const BigInt& f, const Partition& p, int64_t digits_begin, int64_t digits_end);
+// Byte offset reached in heuristic_results.txt (flushed), or -1 if it is not open or no stream is written
+int64_t results_text_position(std::ofstream& out);
+
+// --- Adaptive Budget ---
+// Retunes pool sizes and shake depth between levels so that each level fits a wall-time
+// budget and the process stays under a resident-memory ceiling. Every decision is logged.
+struct AdaptiveBudget {
+    double level_seconds = 0;   // Target wall time per level (0 = no time budget)
+    long long memory_mb = 0;    // Resident memory ceiling (0 = none)
+    int shake_ceiling = 0;      // Largest shake depth the controller may choose
+    int store_n_ceiling = 0;    // store-n to grow back to when memory allows (without a time budget)
+    double pool_ratio_n1 = 1.0; // store-n1 / store-n, kept as the pools are resized
+    double prev_per_candidate = 0;
+    double baseline_mb = 0;     // Resident before the first level (binary, libraries, loaded results)
+    int memory_cut_n = 0;       // Level after which the pending memory cut was made (0 = none)
+    double memory_cut_footprint_mb = 0; // Resident above the baseline when it was made
+    bool memory_cuts_useless = false; // A cut did not shrink the footprint (until RSS is under the ceiling)
+
+    bool enabled() const { return level_seconds > 0 || memory_mb > 0; }
+    void plan_next_level(int n_done, double seconds, unsigned long long candidates, double rss_mb,
+                         size_t pool_filled, int& store_n, int& store_n1, int& shake_k);
+};
+
+// Current resident set size of the process in MB
+double current_rss_mb();
+
 // Function to parse a partition string in format [n1, n2, ..., nk]
 Partition parse_partition(const string& partition_str) {
     Partition result;
@@ -242,9 +465,12 @@ bool read_previous_results(std::vector<std::pair<int, BigInt>>& mathematica_data
 // --- Main Function ---
 
 int main(int argc, char* argv[]) {
+    // Route all GMP allocations through the level arena (pass-through to malloc until it is activated)
+    mp_set_memory_functions(gmp_level_alloc, gmp_level_realloc, gmp_level_free);
+
     // Parse command line arguments
     if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <N> [--shake=k] [--stop-window=L] [--recompute=size] [--store-n=M] [--store-n1=K]" << endl;
+        cerr << "Usage: " << argv[0] << " <N> [--shake=k] [--stop-window=L] [--recompute=size] [--store-n=M] [--store-n1=K] [--arena=0|1] [--arena-mb=M] [--pipeline=0|1] [--shake-prune=R] [--score-cache=PATH] [--score-cache-mb=M] [--level-budget=S] [--mem-limit=MB] [--history=d] [--store-history=K2,K3,...] [--select=top|diverse] [--bucket-quota=Q] [--check-kernels=M] [--c-lambda-stream=PATH]" << endl;
         cerr << "Parameters:" << endl;
         cerr << "  <N>             : Perform heuristic search up to size N" << endl;
         cerr << "  --shake=k       : Set the maximum exact shake parameter (default: 8)" << endl;
@@ -253,6 +479,20 @@ int main(int argc, char* argv[]) {
         cerr << "  --store-n=M     : Maximum number of top partitions to keep in the pool for size n (default: 100)" << endl;
         cerr << "  --store-n1=K    : Maximum number of top partitions to keep in the pool for size n-1 (default: 50)" << endl;
         cerr << "  --store-max=M   : (Legacy) Sets both pool sizes (--store-n=M and --store-n1=M/2)" << endl;
+        cerr << "  --arena=0|1     : Use the per-thread level arena for partitions and GMP scratch (default: 1)" << endl;
+        cerr << "  --arena-mb=M    : Address space reserved per thread for the level arena in MB (default: 4096)" << endl;
+        cerr << "  --pipeline=0|1  : Stream generated candidates straight into evaluation tasks (default: 1)" << endl;
+        cerr << "  --shake-prune=R : (Pipeline only) Skip shaking k=0 candidates scoring below pool cutoff / R (default: 0 = off)" << endl;
+        cerr << "  --score-cache=PATH : Look up and store f^lambda in a persistent cache file shared by concurrent runs" << endl;
+        cerr << "  --score-cache-mb=M : Size limit of a newly created score cache in MB (default: 1024)" << endl;
+        cerr << "  --level-budget=S : Adaptive mode: retune pool sizes and shake depth (at most --shake) to about S seconds per level" << endl;
+        cerr << "  --mem-limit=MB   : Adaptive mode: shrink pools and shake depth when resident memory nears MB, grow them back below it" << endl;
+        cerr << "  --history=d      : (Pipeline only) Keep the pools of sizes n..n-d+1 and extend depth j by j+1 boxes (default: 2)" << endl;
+        cerr << "  --store-history=K2,K3,... : Pool size limits for the depths 2..d-1 (default: store-n1; last value repeats)" << endl;
+        cerr << "  --select=top|diverse : Fill the next pool with the top scores, or under a per-shape-bucket quota (default: top)" << endl;
+        cerr << "  --bucket-quota=Q : (Diverse selection) Pool members allowed per shape bucket (default: store-n/8)" << endl;
+        cerr << "  --check-kernels=M : Cross-check the f^lambda kernels on all partitions of size <= M, then exit (default: off)" << endl;
+        cerr << "  --c-lambda-stream=PATH : Append binary c(lambda) records for partition_updater to PATH (default: off)" << endl;
         cerr << "Performs a heuristic search for partitions" << endl;
         cerr << "maximizing f^lambda up to size N, starting from n=1." << endl;
         cerr << "Results are written to heuristic_results.txt and output in Mathematica format" << endl;
@@ -275,8 +515,21 @@ int main(int argc, char* argv[]) {
     int EARLY_STOP_WINDOW = 10; // Default window length for early stopping (3 means look at j,j+1,j+2)
     int recompute_size = -1; // Default: no recomputation
     // Replace single pool size with two separate pool sizes
-    const int STORED_MAX_PARTITIONS_N = 600; // Max partitions in the pool for size n (used to generate n+1)
-    const int STORED_MAX_PARTITIONS_N_MINUS_1 = 20; // Max partitions in the pool for size n-1 (used to generate n+1)
+    int STORED_MAX_PARTITIONS_N = 600; // Max partitions in the pool for size n (used to generate n+1)
+    int STORED_MAX_PARTITIONS_N_MINUS_1 = 20; // Max partitions in the pool for size n-1 (used to generate n+1)
+    AdaptiveBudget adaptive; // Disabled unless --level-budget or --mem-limit is given
+    bool use_level_arena = true; // Per-thread arena for partitions and GMP scratch, rewound every level
+    long long arena_mb_per_thread = 4096; // Reserved (not committed) address space per thread
+    bool use_pipeline = true; // Overlap generation and evaluation within each level
+    double shake_prune_ratio = 0.0; // 0 disables cutoff-based pruning of shake sources
+    string score_cache_path; // Empty: no persistent score cache
+    long long score_cache_mb = 1024;
+    int history_depth = 2; // Pools n and n-1 only
+    vector<size_t> store_history; // Limits for the depths 2..history_depth-1
+    bool diverse_selection = false; // Per-bucket quotas when filling the next pool
+    int bucket_quota = 0; // 0: store-n / 8
+    int check_kernels_size = 0; // > 0: run the kernel cross-check and exit
+    string c_lambda_stream_path; // Empty: no c(lambda) record stream
     // precise_mode is always true by default
 
     // Parse optional command line arguments
@@ -333,7 +586,7 @@ int main(int argc, char* argv[]) {
                 if (store_n < 1) {
                     cerr << "Warning: store-n parameter must be at least 1. Using default value 100." << endl;
                 } else {
-                    const_cast<int&>(STORED_MAX_PARTITIONS_N) = store_n;
+                    STORED_MAX_PARTITIONS_N = store_n;
                     cout << "Using maximum stored partitions for size n: " << STORED_MAX_PARTITIONS_N << endl;
                 }
             } catch (const std::exception& e) {
@@ -347,7 +600,7 @@ int main(int argc, char* argv[]) {
                 if (store_n1 < 1) {
                     cerr << "Warning: store-n1 parameter must be at least 1. Using default value 50." << endl;
                 } else {
-                    const_cast<int&>(STORED_MAX_PARTITIONS_N_MINUS_1) = store_n1;
+                    STORED_MAX_PARTITIONS_N_MINUS_1 = store_n1;
                     cout << "Using maximum stored partitions for size n-1: " << STORED_MAX_PARTITIONS_N_MINUS_1 << endl;
                 }
             } catch (const std::exception& e) {
@@ -361,8 +614,8 @@ int main(int argc, char* argv[]) {
                 if (store_max < 1) {
                     cerr << "Warning: store-max parameter must be at least 1. Using default values." << endl;
                 } else {
-                    const_cast<int&>(STORED_MAX_PARTITIONS_N) = store_max;
-                    const_cast<int&>(STORED_MAX_PARTITIONS_N_MINUS_1) = store_max / 2; // Set n-1 pool to half the size by default
+                    STORED_MAX_PARTITIONS_N = store_max;
+                    STORED_MAX_PARTITIONS_N_MINUS_1 = store_max / 2; // Set n-1 pool to half the size by default
                     cout << "Legacy parameter: Using maximum stored partitions for size n: " << STORED_MAX_PARTITIONS_N
                          << " and for size n-1: " << STORED_MAX_PARTITIONS_N_MINUS_1 << endl;
                 }
@@ -371,12 +624,180 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        // Parse level arena parameters
+        else if (arg.substr(0, 11) == "--arena-mb=") {
+            try {
+                arena_mb_per_thread = std::stoll(arg.substr(11));
+                if (arena_mb_per_thread < 1) {
+                    cerr << "Warning: arena-mb parameter must be at least 1. Using default value 4096." << endl;
+                    arena_mb_per_thread = 4096;
+                }
+                cout << "Using level arena size per thread: " << arena_mb_per_thread << " MB" << endl;
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid arena-mb parameter. Using default value 4096." << endl;
+            }
+        }
+        else if (arg.substr(0, 8) == "--arena=") {
+            use_level_arena = (arg.substr(8) != "0");
+            cout << "Level arena " << (use_level_arena ? "enabled" : "disabled") << endl;
+        }
+
+        // Parse pipeline parameters
+        else if (arg.substr(0, 11) == "--pipeline=") {
+            use_pipeline = (arg.substr(11) != "0");
+            cout << "Pipelined generation/evaluation " << (use_pipeline ? "enabled" : "disabled") << endl;
+        }
+        // Parse adaptive budget parameters
+        else if (arg.substr(0, 15) == "--level-budget=") {
+            try {
+                adaptive.level_seconds = std::stod(arg.substr(15));
+                if (adaptive.level_seconds < 0) {
+                    cerr << "Warning: level-budget must be non-negative. Ignoring." << endl;
+                    adaptive.level_seconds = 0;
+                }
+                cout << "Using per-level time budget: " << adaptive.level_seconds << " s" << endl;
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid level-budget parameter. Ignoring." << endl;
+            }
+        }
+        else if (arg.substr(0, 12) == "--mem-limit=") {
+            try {
+                adaptive.memory_mb = std::stoll(arg.substr(12));
+                if (adaptive.memory_mb < 0) {
+                    cerr << "Warning: mem-limit must be non-negative. Ignoring." << endl;
+                    adaptive.memory_mb = 0;
+                }
+                cout << "Using memory ceiling: " << adaptive.memory_mb << " MB" << endl;
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid mem-limit parameter. Ignoring." << endl;
+            }
+        }
+        else if (arg.substr(0, 17) == "--score-cache-mb=") {
+            try {
+                score_cache_mb = std::stoll(arg.substr(17));
+                if (score_cache_mb < 1) {
+                    cerr << "Warning: score-cache-mb parameter must be at least 1. Using default value 1024." << endl;
+                    score_cache_mb = 1024;
+                }
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid score-cache-mb parameter. Using default value 1024." << endl;
+            }
+        }
+        else if (arg.substr(0, 14) == "--score-cache=") {
+            score_cache_path = arg.substr(14);
+        }
+        else if (arg.substr(0, 14) == "--shake-prune=") {
+            try {
+                shake_prune_ratio = std::stod(arg.substr(14));
+                if (shake_prune_ratio < 0) {
+                    cerr << "Warning: shake-prune ratio must be non-negative. Pruning disabled." << endl;
+                    shake_prune_ratio = 0.0;
+                }
+                cout << "Using shake pruning ratio: " << shake_prune_ratio << endl;
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid shake-prune parameter. Pruning disabled." << endl;
+            }
+        }
+
+        // Parse pool history parameters
+        else if (arg.substr(0, 10) == "--history=") {
+            try {
+                history_depth = std::stoi(arg.substr(10));
+                if (history_depth < 2) {
+                    cerr << "Warning: history depth must be at least 2. Using default value 2." << endl;
+                    history_depth = 2;
+                }
+                cout << "Using pool history depth: " << history_depth << endl;
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid history parameter. Using default value 2." << endl;
+            }
+        }
+        else if (arg.substr(0, 16) == "--store-history=") {
+            std::stringstream ss(arg.substr(16));
+            string item;
+            store_history.clear();
+            while (std::getline(ss, item, ',')) {
+                try {
+                    int limit = std::stoi(item);
+                    if (limit < 1) throw std::invalid_argument("store-history entries must be positive");
+                    store_history.push_back((size_t)limit);
+                } catch (const std::exception& e) {
+                    cerr << "Warning: Invalid store-history entry '" << item << "' ignored." << endl;
+                }
+            }
+        }
+
+        // Parse pool selection parameters
+        else if (arg.substr(0, 9) == "--select=") {
+            string policy = arg.substr(9);
+            if (policy == "diverse" || policy == "top") {
+                diverse_selection = (policy == "diverse");
+                cout << "Using pool selection policy: " << policy << endl;
+            } else {
+                cerr << "Warning: Unknown selection policy '" << policy << "'. Using top." << endl;
+            }
+        }
+        else if (arg.substr(0, 15) == "--bucket-quota=") {
+            try {
+                bucket_quota = std::stoi(arg.substr(15));
+                if (bucket_quota < 1) {
+                    cerr << "Warning: bucket-quota must be at least 1. Using default store-n/8." << endl;
+                    bucket_quota = 0;
+                }
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid bucket-quota parameter. Using default store-n/8." << endl;
+            }
+        }
+
+        else if (arg.substr(0, 16) == "--check-kernels=") {
+            try {
+                check_kernels_size = std::stoi(arg.substr(16));
+            } catch (const std::exception& e) {
+                cerr << "Warning: Invalid check-kernels parameter. Ignoring." << endl;
+            }
+        }
+
+        else if (arg.substr(0, 18) == "--c-lambda-stream=") {
+            c_lambda_stream_path = arg.substr(18);
+        }
+
         // Unknown parameter
         else {
             cerr << "Warning: Unknown parameter '" << arg << "' ignored." << endl;
         }
     }
 
+    if (check_kernels_size > 0) {
+        return check_hook_kernels(check_kernels_size) ? 0 : 1;
+    }
+
+    // Limits for history depths that --store-history leaves out repeat its last value (or store-n1)
+    PoolHistory pool_history;
+    {
+        vector<size_t> limits;
+        for (int depth = 2; depth < history_depth; ++depth) {
+            size_t idx = depth - 2;
+            if (idx < store_history.size()) limits.push_back(store_history[idx]);
+            else limits.push_back(limits.empty() ? (size_t)STORED_MAX_PARTITIONS_N_MINUS_1 : limits.back());
+        }
+        pool_history.configure(history_depth, limits);
+        if (history_depth > 2 && !use_pipeline) {
+            cerr << "Warning: --history applies to the pipelined level only; --pipeline=0 uses the n and n-1 pools." << endl;
+        }
+    }
+
+    // In adaptive mode --shake is the deepest shake allowed; pool sizes start from --store-n/--store-n1
+    adaptive.shake_ceiling = MAX_SHAKE_K;
+    adaptive.store_n_ceiling = STORED_MAX_PARTITIONS_N;
+    adaptive.pool_ratio_n1 = (double)STORED_MAX_PARTITIONS_N_MINUS_1 / STORED_MAX_PARTITIONS_N;
+
+    // One arena slot per OpenMP thread (plus one for the main thread if it is not part of the team)
+    level_arena_init(use_level_arena, (size_t)arena_mb_per_thread << 20, omp_get_max_threads() + 1);
+
+    if (!score_cache_path.empty()) {
+        score_cache_open(score_cache_path, score_cache_mb);
+    }
+
     // Mathematica format data storage
     std::vector<std::pair<int, BigInt>> mathematica_data;
     std::vector<std::pair<int, std::vector<Partition>>> size_to_partitions;
@@ -385,6 +806,13 @@ int main(int argc, char* argv[]) {
     int max_n_found = 0;
     bool has_previous_results = read_previous_results(mathematica_data, size_to_partitions, max_n_found);
 
+    // A new results file, or one rewritten for --recompute, starts a new record stream
+    if (!c_lambda_stream_path.empty() &&
+        !c_lambda_stream_open(c_lambda_stream_path, !has_previous_results || recompute_size > 0)) {
+        cerr << "Error: Could not open c(lambda) stream " << c_lambda_stream_path << "." << endl;
+        return 1;
+    }
+
     // Handle recomputation options
     if (has_previous_results) {
         if (recompute_size > 0) {
@@ -629,160 +1057,208 @@ int main(int argc, char* argv[]) {
             pool_n.push_back({current_max_f_lambda, p1});
 
             outfile << "--- Size 1 ---" << endl;
-            outfile << "Max f^lambda: " << current_max_f_lambda << " (achieved by 1 partition)" << endl;
+            outfile << "Max f^lambda: ";
+            int64_t digits_begin = results_text_position(outfile);
+            outfile << current_max_f_lambda;
+            int64_t digits_end = results_text_position(outfile);
+            outfile << " (achieved by 1 partition)" << endl;
             outfile << "Partitions achieving maximum: " << partition_to_string(p1) << endl;
+            c_lambda_stream_write(1, current_max_f_lambda, p1, digits_begin, digits_end);
 
             // Store for Mathematica output
             mathematica_data.push_back({1, current_max_f_lambda});
         }
     }
 
+    // Seed the deeper history from the maximizers on file (deepest first, so each lands at its depth)
+    if (has_previous_results) {
+        for (int depth = pool_history.deepest(); depth >= 2; --depth) {
+            int size = start_n - depth;
+            vector<ScoredPartition> pool;
+            for (const auto& entry : size_to_partitions) {
+                if (entry.first != size) continue;
+                BigInt score = 0;
+                for (const auto& data : mathematica_data) {
+                    if (data.first == size) {
+                        score = data.second;
+                        break;
+                    }
+                }
+                for (const auto& p : entry.second) pool.push_back({score, p});
+                break;
+            }
+            pool_history.push(std::move(pool));
+        }
+    }
+
     // --- Heuristic Iteration ---
+    adaptive.baseline_mb = current_rss_mb();
     for (int n = start_n; (recompute_size > 0 ? n < recompute_size : n < N); ++n) {
         cout << "Processing n = " << n << " -> n = " << n + 1 << "..." << endl;
 
+        auto level_start_time = std::chrono::steady_clock::now();
+
         // Clear G' cache at the start of each iteration to prevent memory growth
         clear_g_prime_cache();
 
-        // 1. Candidate Generation Phase (Size n+1)
-        PartitionSet all_unique_candidates_for_n_plus_1;
+        // Everything allocated during the previous level has been destroyed by now: rewind the arena
+        // Under a memory ceiling the pages go back to the OS, so resident memory follows the settings
+        level_arena_reset(adaptive.memory_mb > 0);
+        level_arena_set_active(true);
 
-        // --- Generation from pool_n (Size n -> n+1) ---
-        PartitionSet k0_candidates_from_n;
-        cout << "  Generating initial (k=0, n->n+1) candidates from " << pool_n.size() << " partitions in pool_n..." << endl;
-        for (const auto& scored_p_n : pool_n) {
-            const Partition& p_n = scored_p_n.second;
-            if (!is_in_subgraph_G_prime(p_n)) {
-                cerr << "Warning: Pool partition " << partition_to_string(p_n) << " is not in G'. Skipping initial candidate generation from it." << endl;
-                continue;
-            }
-
-            vector<Partition> generated_next = add_box(p_n);
-            for (const auto& cand : generated_next) {
-                if (is_in_subgraph_G_prime(cand)) {
-                    k0_candidates_from_n.insert(cand);
-                }
-            }
-        }
-        cout << "  Found " << k0_candidates_from_n.size() << " unique k=0 candidates (from n) in G'." << endl;
-        all_unique_candidates_for_n_plus_1.insert(k0_candidates_from_n.begin(), k0_candidates_from_n.end());
-
-        // Generate Shaken Candidates (k=1 to MAX_SHAKE_K) from pool_n
-        cout << "  Generating shaken (k>0, n->n+1) candidates from k=0 set..." << endl;
-        for (int shake_k = 1; shake_k <= MAX_SHAKE_K; ++shake_k) {
-            cout << "    Generating for exact shake k=" << shake_k << " (from n source)..." << endl;
-            PartitionSet k_shaken_candidates_this_level;
-            int initial_cand_count = 0;
-
-            #pragma omp parallel for schedule(dynamic)
-            for (size_t i = 0; i < k0_candidates_from_n.size(); ++i) {
-                const auto& initial_cand = *(std::next(k0_candidates_from_n.begin(), i));
-                PartitionSet shaken = generate_shaken_candidates(initial_cand, shake_k);
-
-                #pragma omp critical
-                {
-                    k_shaken_candidates_this_level.insert(shaken.begin(), shaken.end());
-                    // Progress reporting within the loop
-                    initial_cand_count++;
-                    if (initial_cand_count % 100 == 0) {
-                        cout << "      Shaken " << initial_cand_count << "/" << k0_candidates_from_n.size()
-                             << " initial candidates for k=" << shake_k << " (n source)" << endl;
-                    }
+        vector<ScoredPartition> evaluated_candidates_for_n_plus_1;
+        score_cache_begin_level();
+        if (use_pipeline) {
+            // 1+2. Pipelined Generation and Evaluation (Size n+1)
+            size_t keep = (size_t)STORED_MAX_PARTITIONS_N * (diverse_selection ? DIVERSE_OVERSAMPLE : 1);
+            run_pipelined_level(pool_n, pool_n_minus_1, pool_history, n, MAX_SHAKE_K, keep,
+                                shake_prune_ratio, evaluated_candidates_for_n_plus_1);
+        } else {
+            // 1. Candidate Generation Phase (Size n+1)
+            PartitionSet all_unique_candidates_for_n_plus_1;
+
+            // --- Generation from pool_n (Size n -> n+1) ---
+            PartitionSet k0_candidates_from_n;
+            cout << "  Generating initial (k=0, n->n+1) candidates from " << pool_n.size() << " partitions in pool_n..." << endl;
+            for (const auto& scored_p_n : pool_n) {
+                const Partition& p_n = scored_p_n.second;
+                if (!is_in_subgraph_G_prime(p_n)) {
+                    cerr << "Warning: Pool partition " << partition_to_string(p_n) << " is not in G'. Skipping initial candidate generation from it." << endl;
+                    continue;
                 }
-            }
-
-            size_t before_insert_size = all_unique_candidates_for_n_plus_1.size();
-            all_unique_candidates_for_n_plus_1.insert(k_shaken_candidates_this_level.begin(), k_shaken_candidates_this_level.end());
-            size_t added_count = all_unique_candidates_for_n_plus_1.size() - before_insert_size;
 
-            cout << "    Found " << k_shaken_candidates_this_level.size() << " raw candidates for k=" << shake_k << " (n source)"
-                 << ", added " << added_count << " new unique candidates to the total pool." << endl;
-        }
-        cout << "  Candidate generation from pool_n complete." << endl;
-
-        // --- Generation from pool_n_minus_1 (Size n-1 -> n+1) ---
-        if (n >= 2) { // Only run if pool_n_minus_1 is meaningful
-            PartitionSet k0_candidates_from_n_minus_1;
-            cout << "  Generating initial (k=0, n-1->n+1) candidates from " << pool_n_minus_1.size() << " partitions in pool_n_minus_1..." << endl;
-            for (const auto& scored_p_n_minus_1 : pool_n_minus_1) {
-                const Partition& p_n_minus_1 = scored_p_n_minus_1.second;
-                if (!is_in_subgraph_G_prime(p_n_minus_1)) continue; // Check base partition
-
-                PartitionSet two_box_candidates = add_two_boxes(p_n_minus_1);
-                for (const auto& cand : two_box_candidates) {
+                vector<Partition> generated_next = add_box(p_n);
+                for (const auto& cand : generated_next) {
                     if (is_in_subgraph_G_prime(cand)) {
-                        k0_candidates_from_n_minus_1.insert(cand);
+                        k0_candidates_from_n.insert(cand);
                     }
                 }
             }
-            cout << "  Found " << k0_candidates_from_n_minus_1.size() << " unique k=0 candidates (from n-1) in G'." << endl;
-            size_t before_insert_n1_k0 = all_unique_candidates_for_n_plus_1.size();
-            all_unique_candidates_for_n_plus_1.insert(k0_candidates_from_n_minus_1.begin(), k0_candidates_from_n_minus_1.end());
-            cout << "    Added " << all_unique_candidates_for_n_plus_1.size() - before_insert_n1_k0 << " new unique candidates from n-1 (k=0) source." << endl;
+            cout << "  Found " << k0_candidates_from_n.size() << " unique k=0 candidates (from n) in G'." << endl;
+            all_unique_candidates_for_n_plus_1.insert(k0_candidates_from_n.begin(), k0_candidates_from_n.end());
 
-            cout << "  Generating shaken (k>0, n-1->n+1) candidates from k=0 (n-1) set..." << endl;
+            // Generate Shaken Candidates (k=1 to MAX_SHAKE_K) from pool_n
+            cout << "  Generating shaken (k>0, n->n+1) candidates from k=0 set..." << endl;
             for (int shake_k = 1; shake_k <= MAX_SHAKE_K; ++shake_k) {
-                cout << "    Generating for exact shake k=" << shake_k << " (from n-1 source)..." << endl;
-                PartitionSet k_shaken_candidates_n1_source;
+                cout << "    Generating for exact shake k=" << shake_k << " (from n source)..." << endl;
+                PartitionSet k_shaken_candidates_this_level;
+                int initial_cand_count = 0;
 
                 #pragma omp parallel for schedule(dynamic)
-                for (size_t i = 0; i < k0_candidates_from_n_minus_1.size(); ++i) {
-                    const auto& initial_cand = *(std::next(k0_candidates_from_n_minus_1.begin(), i));
+                for (size_t i = 0; i < k0_candidates_from_n.size(); ++i) {
+                    const auto& initial_cand = *(std::next(k0_candidates_from_n.begin(), i));
                     PartitionSet shaken = generate_shaken_candidates(initial_cand, shake_k);
 
                     #pragma omp critical
                     {
-                        k_shaken_candidates_n1_source.insert(shaken.begin(), shaken.end());
+                        k_shaken_candidates_this_level.insert(shaken.begin(), shaken.end());
+                        // Progress reporting within the loop
+                        initial_cand_count++;
+                        if (initial_cand_count % 100 == 0) {
+                            cout << "      Shaken " << initial_cand_count << "/" << k0_candidates_from_n.size()
+                                 << " initial candidates for k=" << shake_k << " (n source)" << endl;
+                        }
                     }
                 }
 
-                size_t before_insert_n1_k = all_unique_candidates_for_n_plus_1.size();
-                all_unique_candidates_for_n_plus_1.insert(k_shaken_candidates_n1_source.begin(), k_shaken_candidates_n1_source.end());
-                cout << "    Found " << k_shaken_candidates_n1_source.size() << " raw candidates (k=" << shake_k << ", n-1 src)"
-                     << ", added " << all_unique_candidates_for_n_plus_1.size() - before_insert_n1_k << " new unique candidates." << endl;
+                size_t before_insert_size = all_unique_candidates_for_n_plus_1.size();
+                all_unique_candidates_for_n_plus_1.insert(k_shaken_candidates_this_level.begin(), k_shaken_candidates_this_level.end());
+                size_t added_count = all_unique_candidates_for_n_plus_1.size() - before_insert_size;
+
+                cout << "    Found " << k_shaken_candidates_this_level.size() << " raw candidates for k=" << shake_k << " (n source)"
+                     << ", added " << added_count << " new unique candidates to the total pool." << endl;
             }
-            cout << "  Candidate generation from pool_n_minus_1 complete." << endl;
-        } else {
-            cout << "  Skipping candidate generation from n-1 pool (n=" << n << ")." << endl;
-        }
-        // --- End Generation from pool_n_minus_1 ---
+            cout << "  Candidate generation from pool_n complete." << endl;
+
+            // --- Generation from pool_n_minus_1 (Size n-1 -> n+1) ---
+            if (n >= 2) { // Only run if pool_n_minus_1 is meaningful
+                PartitionSet k0_candidates_from_n_minus_1;
+                cout << "  Generating initial (k=0, n-1->n+1) candidates from " << pool_n_minus_1.size() << " partitions in pool_n_minus_1..." << endl;
+                for (const auto& scored_p_n_minus_1 : pool_n_minus_1) {
+                    const Partition& p_n_minus_1 = scored_p_n_minus_1.second;
+                    if (!is_in_subgraph_G_prime(p_n_minus_1)) continue; // Check base partition
+
+                    PartitionSet two_box_candidates = add_two_boxes(p_n_minus_1);
+                    for (const auto& cand : two_box_candidates) {
+                        if (is_in_subgraph_G_prime(cand)) {
+                            k0_candidates_from_n_minus_1.insert(cand);
+                        }
+                    }
+                }
+                cout << "  Found " << k0_candidates_from_n_minus_1.size() << " unique k=0 candidates (from n-1) in G'." << endl;
+                size_t before_insert_n1_k0 = all_unique_candidates_for_n_plus_1.size();
+                all_unique_candidates_for_n_plus_1.insert(k0_candidates_from_n_minus_1.begin(), k0_candidates_from_n_minus_1.end());
+                cout << "    Added " << all_unique_candidates_for_n_plus_1.size() - before_insert_n1_k0 << " new unique candidates from n-1 (k=0) source." << endl;
+
+                cout << "  Generating shaken (k>0, n-1->n+1) candidates from k=0 (n-1) set..." << endl;
+                for (int shake_k = 1; shake_k <= MAX_SHAKE_K; ++shake_k) {
+                    cout << "    Generating for exact shake k=" << shake_k << " (from n-1 source)..." << endl;
+                    PartitionSet k_shaken_candidates_n1_source;
+
+                    #pragma omp parallel for schedule(dynamic)
+                    for (size_t i = 0; i < k0_candidates_from_n_minus_1.size(); ++i) {
+                        const auto& initial_cand = *(std::next(k0_candidates_from_n_minus_1.begin(), i));
+                        PartitionSet shaken = generate_shaken_candidates(initial_cand, shake_k);
+
+                        #pragma omp critical
+                        {
+                            k_shaken_candidates_n1_source.insert(shaken.begin(), shaken.end());
+                        }
+                    }
 
-        cout << "  Total unique candidates generated for n = " << n + 1 << " from ALL sources: " << all_unique_candidates_for_n_plus_1.size() << endl;
+                    size_t before_insert_n1_k = all_unique_candidates_for_n_plus_1.size();
+                    all_unique_candidates_for_n_plus_1.insert(k_shaken_candidates_n1_source.begin(), k_shaken_candidates_n1_source.end());
+                    cout << "    Found " << k_shaken_candidates_n1_source.size() << " raw candidates (k=" << shake_k << ", n-1 src)"
+                         << ", added " << all_unique_candidates_for_n_plus_1.size() - before_insert_n1_k << " new unique candidates." << endl;
+                }
+                cout << "  Candidate generation from pool_n_minus_1 complete." << endl;
+            } else {
+                cout << "  Skipping candidate generation from n-1 pool (n=" << n << ")." << endl;
+            }
+            // --- End Generation from pool_n_minus_1 ---
 
-        // 2. Evaluation Phase (Size n+1)
-        vector<ScoredPartition> evaluated_candidates_for_n_plus_1;
-        evaluated_candidates_for_n_plus_1.reserve(all_unique_candidates_for_n_plus_1.size());
-        std::mutex eval_mutex; // Mutex for thread-safe push_back to vector
-        long long evaluated_count = 0;
+            cout << "  Total unique candidates generated for n = " << n + 1 << " from ALL sources: " << all_unique_candidates_for_n_plus_1.size() << endl;
 
-        cout << "  Evaluating " << all_unique_candidates_for_n_plus_1.size() << " total unique candidates for n = " << n + 1 << "..." << endl;
+            // 2. Evaluation Phase (Size n+1)
+            evaluated_candidates_for_n_plus_1.reserve(all_unique_candidates_for_n_plus_1.size());
+            std::mutex eval_mutex; // Mutex for thread-safe push_back to vector
+            long long evaluated_count = 0;
 
-        #pragma omp parallel for schedule(dynamic)
-        for (size_t i = 0; i < all_unique_candidates_for_n_plus_1.size(); ++i) {
-            const auto& cand = *(std::next(all_unique_candidates_for_n_plus_1.begin(), i));
-            BigInt f_cand = countSYT_gmp(cand);
+            cout << "  Evaluating " << all_unique_candidates_for_n_plus_1.size() << " total unique candidates for n = " << n + 1 << "..." << endl;
 
-            if (f_cand != -1) { // Check for errors from countSYT_gmp
-                // Add result to shared vector under lock
-                std::lock_guard<std::mutex> lock(eval_mutex);
-                evaluated_candidates_for_n_plus_1.push_back({f_cand, cand});
-            }
+            #pragma omp parallel for schedule(dynamic)
+            for (size_t i = 0; i < all_unique_candidates_for_n_plus_1.size(); ++i) {
+                const auto& cand = *(std::next(all_unique_candidates_for_n_plus_1.begin(), i));
+                BigInt f_cand = score_partition(cand);
+
+                if (f_cand != -1) { // Check for errors from countSYT_gmp
+                    // Add result to shared vector under lock
+                    std::lock_guard<std::mutex> lock(eval_mutex);
+                    evaluated_candidates_for_n_plus_1.push_back({f_cand, cand});
+                }
 
-            // Thread-safe progress reporting
-            long long current_eval_count;
-            #pragma omp atomic update
-            evaluated_count++;
-            current_eval_count = evaluated_count; // Read atomic value
+                // Thread-safe progress reporting
+                long long current_eval_count;
+                #pragma omp atomic update
+                evaluated_count++;
+                current_eval_count = evaluated_count; // Read atomic value
 
-            if (current_eval_count % 1000 == 0) { // Report every 1000 evaluations
-                #pragma omp critical
-                {
-                    cout << "    Evaluated " << current_eval_count << "/" << all_unique_candidates_for_n_plus_1.size() << " candidates..." << endl;
+                if (current_eval_count % 1000 == 0) { // Report every 1000 evaluations
+                    #pragma omp critical
+                    {
+                        cout << "    Evaluated " << current_eval_count << "/" << all_unique_candidates_for_n_plus_1.size() << " candidates..." << endl;
+                    }
                 }
             }
+
+            cout << "  Evaluation complete. Found " << evaluated_candidates_for_n_plus_1.size() << " valid scored candidates." << endl;
         }
+        score_cache_end_level();
+        unsigned long long level_candidate_count = take_level_scoring_count();
+        auto level_end_time = std::chrono::steady_clock::now();
 
-        cout << "  Evaluation complete. Found " << evaluated_candidates_for_n_plus_1.size() << " valid scored candidates." << endl;
+        // Selection copies the survivors to the heap; they must outlive the arena
+        level_arena_set_active(false);
 
         // Check if any candidates were successfully evaluated
         if (evaluated_candidates_for_n_plus_1.empty()) {
@@ -822,37 +1298,47 @@ int main(int argc, char* argv[]) {
 
         // Create the pool for the next iteration (n+1 -> n+2)
         vector<ScoredPartition> next_top_partitions_pool;
-        PartitionSet added_to_pool_set; // Track unique partitions added to the pool
-        BigInt cutoff_score = -1; // Score of the last partition added if limit is reached
-
-        cout << "  Selecting top partitions for the next pool (limit " << STORED_MAX_PARTITIONS_N << ")..." << endl;
-        for (const auto& scored_cand : evaluated_candidates_for_n_plus_1) {
-            bool should_add = false;
-            if (next_top_partitions_pool.size() < STORED_MAX_PARTITIONS_N) {
-                // Add if pool is not full and partition is unique
-                should_add = true;
-            } else {
-                // Pool is full, check if current score is >= cutoff score (handle ties)
-                if (cutoff_score == -1) { // Set cutoff score first time limit is hit
-                    cutoff_score = next_top_partitions_pool.back().first;
-                }
-                if (scored_cand.first >= cutoff_score) {
+        if (diverse_selection) {
+            size_t quota = bucket_quota > 0 ? (size_t)bucket_quota : max<size_t>(1, STORED_MAX_PARTITIONS_N / 8);
+            size_t buckets_used = 0;
+            cout << "  Selecting diverse partitions for the next pool (limit " << STORED_MAX_PARTITIONS_N
+                 << ", quota " << quota << " per bucket)..." << endl;
+            next_top_partitions_pool = select_diverse_pool(evaluated_candidates_for_n_plus_1, n + 1,
+                                                           STORED_MAX_PARTITIONS_N, quota, buckets_used);
+            cout << "  Pool spans " << buckets_used << " shape buckets." << endl;
+        } else {
+            PartitionSet added_to_pool_set; // Track unique partitions added to the pool
+            BigInt cutoff_score = -1; // Score of the last partition added if limit is reached
+
+            cout << "  Selecting top partitions for the next pool (limit " << STORED_MAX_PARTITIONS_N << ")..." << endl;
+            for (const auto& scored_cand : evaluated_candidates_for_n_plus_1) {
+                bool should_add = false;
+                if (next_top_partitions_pool.size() < (size_t)STORED_MAX_PARTITIONS_N) {
+                    // Add if pool is not full and partition is unique
                     should_add = true;
                 } else {
-                    // Score is lower than cutoff, and pool is full. Stop adding.
-                    break;
+                    // Pool is full, check if current score is >= cutoff score (handle ties)
+                    if (cutoff_score == -1) { // Set cutoff score first time limit is hit
+                        cutoff_score = next_top_partitions_pool.back().first;
+                    }
+                    if (scored_cand.first >= cutoff_score) {
+                        should_add = true;
+                    } else {
+                        // Score is lower than cutoff, and pool is full. Stop adding.
+                        break;
+                    }
                 }
-            }
 
-            // Add the partition if it meets criteria and is unique
-            if (should_add) {
-                // Use emplace for potential efficiency
-                auto insert_result = added_to_pool_set.insert(scored_cand.second);
-                if (insert_result.second) { // Check if insertion happened (i.e., was unique)
-                    next_top_partitions_pool.push_back(scored_cand);
-                    // Update cutoff score if we just reached the limit
-                    if (next_top_partitions_pool.size() == STORED_MAX_PARTITIONS_N) {
-                        cutoff_score = scored_cand.first;
+                // Add the partition if it meets criteria and is unique
+                if (should_add) {
+                    // Use emplace for potential efficiency
+                    auto insert_result = added_to_pool_set.insert(scored_cand.second);
+                    if (insert_result.second) { // Check if insertion happened (i.e., was unique)
+                        next_top_partitions_pool.push_back(scored_cand);
+                        // Update cutoff score if we just reached the limit
+                        if (next_top_partitions_pool.size() == (size_t)STORED_MAX_PARTITIONS_N) {
+                            cutoff_score = scored_cand.first;
+                        }
                     }
                 }
             }
@@ -861,29 +1347,16 @@ int main(int argc, char* argv[]) {
         cout << "  Selected " << next_top_partitions_pool.size() << " partitions for the next iteration's pool." << endl;
 
         // Update pools for the next iteration (n+1 -> n+2)
+        if (pool_history.deepest() >= 2) {
+            pool_history.push(std::move(pool_n_minus_1)); // The current n-1 pool moves to depth 2
+        }
         pool_n_minus_1 = std::move(pool_n); // The current n pool becomes the next n-1 pool
         pool_n = std::move(next_top_partitions_pool); // The new n+1 pool becomes the next n pool
 
         // Apply size limit to pool_n_minus_1 if needed
-        if (pool_n_minus_1.size() > STORED_MAX_PARTITIONS_N_MINUS_1) {
-            // Sort by score (should be sorted already, but just to be safe)
-            std::sort(pool_n_minus_1.begin(), pool_n_minus_1.end(),
-                [](const ScoredPartition& a, const ScoredPartition& b) {
-                    // Primary sort: score descending
-                    if (a.first != b.first) {
-                        return a.first > b.first;
-                    }
-                    // Secondary sort: partition lexicographical (optional, for consistency)
-                    return a.second < b.second;
-                });
-
-            BigInt cutoff_score_n1 = pool_n_minus_1[STORED_MAX_PARTITIONS_N_MINUS_1 - 1].first;
-
+        if (pool_n_minus_1.size() > (size_t)STORED_MAX_PARTITIONS_N_MINUS_1) {
             // If there are ties at the cutoff, we might slightly exceed the limit
-            pool_n_minus_1.erase(
-                std::remove_if(pool_n_minus_1.begin(), pool_n_minus_1.end(),
-                              [&](const ScoredPartition& sp){ return sp.first < cutoff_score_n1; }),
-                pool_n_minus_1.end());
+            trim_scored_pool(pool_n_minus_1, STORED_MAX_PARTITIONS_N_MINUS_1);
 
             cout << "  Trimmed pool_n_minus_1 to size " << pool_n_minus_1.size()
                  << " (limit " << STORED_MAX_PARTITIONS_N_MINUS_1 << ") for next iteration." << endl;
@@ -902,18 +1375,39 @@ int main(int argc, char* argv[]) {
             outfile << "Max f^lambda: 0 (No partitions found achieving max within G')" << endl;
             cout << "Warning: No best partitions found for n = " << n+1 << " within G'." << endl;
         } else {
-            outfile << "Max f^lambda: " << current_max_f_lambda << " (achieved by " << count << " partition" << (count == 1 ? "" : "s") << " in G')" << endl;
+            outfile << "Max f^lambda: ";
+            int64_t digits_begin = results_text_position(outfile);
+            outfile << current_max_f_lambda;
+            int64_t digits_end = results_text_position(outfile);
+            outfile << " (achieved by " << count << " partition" << (count == 1 ? "" : "s") << " in G')" << endl;
             outfile << "Partitions achieving maximum: ";
             std::sort(overall_best_partitions_for_n.begin(), overall_best_partitions_for_n.end()); // Sort for consistent output
             for (size_t i = 0; i < overall_best_partitions_for_n.size(); ++i) {
                 outfile << partition_to_string(overall_best_partitions_for_n[i]) << (i == overall_best_partitions_for_n.size() - 1 ? "" : ", ");
             }
             outfile << endl;
+
+            // The first listed maximizer is the one partition_updater stores
+            c_lambda_stream_write(n + 1, current_max_f_lambda, overall_best_partitions_for_n[0], digits_begin, digits_end);
         }
 
         // Basic progress update to console
         cout << "  Found max f^lambda = " << current_max_f_lambda << " for n = " << n+1 << " within G'." << endl;
 
+        LevelArenaStats arena_stats = level_arena_collect_stats(true);
+        cout << "  Allocations for n = " << n+1 << ": " << arena_stats.requests << " requests, "
+             << arena_stats.heap << " served by malloc, " << arena_stats.recycled << " recycled, "
+             << arena_stats.bumped << " carved from the arena ("
+             << std::fixed << std::setprecision(1) << arena_stats.arena_bytes_used / 1048576.0 << " MB)" << endl;
+        cout << "  Generation/evaluation wall time for n = " << n+1 << ": "
+             << std::chrono::duration<double>(level_end_time - level_start_time).count() << " s" << endl;
+        cout.unsetf(std::ios_base::floatfield);
+
+        // Retune pool sizes and shake depth for the next level from what this one cost
+        adaptive.plan_next_level(n + 1, std::chrono::duration<double>(std::chrono::steady_clock::now() - level_start_time).count(),
+                                 level_candidate_count, current_rss_mb(), pool_n.size(),
+                                 STORED_MAX_PARTITIONS_N, STORED_MAX_PARTITIONS_N_MINUS_1, MAX_SHAKE_K);
+
         // Print current time to stderr
         auto now = std::chrono::system_clock::now();
         std::time_t current_time = std::chrono::system_clock::to_time_t(now);
@@ -1227,6 +1721,545 @@ PartitionSet generate_shaken_candidates(const Partition& lambda_start, int exact
     return final_shaken_partitions_Gprime;
 }
 
+PartitionSet generate_shaken_candidates_upto(const Partition& lambda_start, int max_k) {
+    PartitionSet shaken_partitions_Gprime;
+    if (!is_in_subgraph_G_prime(lambda_start)) {
+        return shaken_partitions_Gprime;
+    }
+
+    // Same BFS as generate_shaken_candidates; every level is kept instead of only the last one
+    PartitionSet current_level_partitions;
+    current_level_partitions.insert(lambda_start);
+    PartitionSet all_reachable_partitions;
+    all_reachable_partitions.insert(lambda_start);
+
+    for (int k = 1; k <= max_k && !current_level_partitions.empty(); ++k) {
+        PartitionSet next_level_partitions;
+        for (const auto& p : current_level_partitions) {
+            for (const auto& r : remove_box(p)) {
+                for (const auto& a : add_box(r)) {
+                    if (all_reachable_partitions.insert(a).second && is_in_subgraph_G_prime(a)) {
+                        next_level_partitions.insert(a);
+                        shaken_partitions_Gprime.insert(a);
+                    }
+                }
+            }
+        }
+        current_level_partitions = std::move(next_level_partitions);
+    }
+
+    shaken_partitions_Gprime.erase(lambda_start);
+    return shaken_partitions_Gprime;
+}
+
+// --- Work-Stealing Executor ---
+// One deque per OpenMP thread. Owners push and pop at the back, idle workers steal from
+// the front of the others. wait() keeps running tasks until a counter drops to zero, so a
+// task can fork subtasks and join them without blocking its worker.
+
+class WorkStealingExecutor {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingExecutor(int num_workers) {
+        for (int w = 0; w < max(1, num_workers); ++w) workers_.emplace_back(new Worker());
+    }
+
+    int num_workers() const { return (int)workers_.size(); }
+
+    // Index of the calling worker (0 outside run())
+    int worker_id() const { return t_worker_id_ >= 0 ? t_worker_id_ : 0; }
+
+    unsigned long long steal_count() const { return steals_.load(); }
+
+    // Queue a task on the calling worker's deque
+    void spawn(Task task) {
+        pending_++;
+        Worker& self = *workers_[worker_id()];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.tasks.push_back(std::move(task));
+    }
+
+    // Run root and everything it spawns; returns when no task is left
+    void run(Task root) {
+        spawn(std::move(root));
+        #pragma omp parallel num_threads(num_workers())
+        {
+            t_worker_id_ = omp_get_thread_num();
+            while (pending_.load() > 0) {
+                if (!run_one()) std::this_thread::yield();
+            }
+            t_worker_id_ = -1;
+        }
+    }
+
+    // Help with queued tasks until counter reaches zero
+    void wait(std::atomic<long>& counter) {
+        while (counter.load() > 0) {
+            if (!run_one()) std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool run_one() {
+        int self = worker_id();
+        Task task;
+        {
+            Worker& own = *workers_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (int i = 1; !task && i < num_workers(); ++i) {
+            Worker& victim = *workers_[(self + i) % num_workers()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                steals_++;
+            }
+        }
+        if (!task) return false;
+        task();
+        pending_--;
+        return true;
+    }
+
+    vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<long long> pending_{0};
+    std::atomic<unsigned long long> steals_{0};
+    static thread_local int t_worker_id_;
+};
+
+thread_local int WorkStealingExecutor::t_worker_id_ = -1;
+
+// --- Pipelined Level ---
+
+static const size_t PIPELINE_EVAL_BATCH = 64; // Candidates per evaluation task
+static const size_t PIPELINE_SPLIT_FRONTIER = 256; // Shake frontiers above this are expanded by subtasks
+static const double PREFILTER_MARGIN = 1e-9;        // Relative slack of the log-hook prefilter
+
+static inline size_t partition_hash(const Partition& p) {
+    unsigned long long h = 1469598103934665603ULL; // FNV-1a over the parts
+    for (unsigned int part : p) {
+        h ^= part;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+static inline double bigint_log2(const BigInt& x) {
+    long exp;
+    double mant = mpz_get_d_2exp(&exp, x.get_mpz_t());
+    return std::log2(mant) + exp;
+}
+
+static bool scored_partition_greater(const ScoredPartition& a, const ScoredPartition& b) {
+    if (a.first != b.first) {
+        return a.first > b.first;
+    }
+    return a.second < b.second;
+}
+
+void trim_scored_pool(vector<ScoredPartition>& pool, size_t limit) {
+    if (pool.size() <= limit) return;
+    std::sort(pool.begin(), pool.end(), scored_partition_greater);
+    if (limit == 0) {
+        pool.clear();
+        return;
+    }
+    BigInt cutoff = pool[limit - 1].first;
+    pool.erase(std::remove_if(pool.begin(), pool.end(),
+                              [&](const ScoredPartition& sp) { return sp.first < cutoff; }),
+               pool.end());
+}
+
+uint64_t shape_bucket(const Partition& p, unsigned int step) {
+    unsigned long long core = 0;
+    for (unsigned int part : get_base_symmetric_subdiagram(p)) core += part;
+    unsigned long long first_row = p.empty() ? 0 : p[0] / step;
+    unsigned long long rows = p.size() / step;
+    return (core << 32) | ((first_row & 0xFFFF) << 16) | (rows & 0xFFFF);
+}
+
+vector<ScoredPartition> select_diverse_pool(const vector<ScoredPartition>& sorted_candidates, int n,
+                                            size_t limit, size_t quota, size_t& buckets_used) {
+    vector<ScoredPartition> pool;
+    vector<size_t> skipped; // Indices over quota, in score order; at most `limit` are ever needed
+    std::map<uint64_t, size_t> bucket_count;
+    unsigned int step = max(1u, (unsigned int)std::lround(std::sqrt((double)n) / 2));
+    const BigInt& best = sorted_candidates.empty() ? BigInt(0) : sorted_candidates.front().first;
+
+    for (size_t i = 0; i < sorted_candidates.size() && pool.size() < limit; ++i) {
+        const ScoredPartition& sc = sorted_candidates[i];
+        size_t& count = bucket_count[shape_bucket(sc.second, step)];
+        if (count < quota || sc.first == best) {
+            ++count;
+            pool.push_back(sc);
+        } else if (skipped.size() < limit) {
+            skipped.push_back(i);
+        }
+    }
+    // Too few buckets to fill the pool: the best skipped candidates take the remaining places
+    for (size_t k = 0; k < skipped.size() && pool.size() < limit; ++k) {
+        pool.push_back(sorted_candidates[skipped[k]]);
+    }
+    std::sort(pool.begin(), pool.end(), scored_partition_greater);
+
+    buckets_used = 0;
+    for (const auto& entry : bucket_count) {
+        if (entry.second > 0) ++buckets_used;
+    }
+    return pool;
+}
+
+void PoolHistory::configure(int depth, const vector<size_t>& limits) {
+    slots_.assign(depth > 2 ? depth - 2 : 0, vector<ScoredPartition>());
+    limits_ = limits;
+    limits_.resize(slots_.size(), limits_.empty() ? 0 : limits_.back());
+    head_ = 0;
+}
+
+void PoolHistory::push(vector<ScoredPartition>&& pool) {
+    if (slots_.empty()) return;
+    head_ = (head_ + slots_.size() - 1) % slots_.size(); // The deepest slot becomes depth 2
+    slots_[head_] = std::move(pool);
+    // Every pool moved one depth down; deeper depths may have smaller limits
+    for (int depth = 2; depth <= deepest(); ++depth) {
+        trim_scored_pool(slots_[slot_index(depth)], limit(depth));
+    }
+}
+
+// Candidate set shared by concurrent generators; each shard has its own lock
+class ShardedPartitionSet {
+public:
+    static const int NUM_SHARDS = 64;
+
+    bool insert(const Partition& p) {
+        Shard& shard = shards_[partition_hash(p) % NUM_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.set.insert(p).second;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) total += shard.set.size();
+        return total;
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        PartitionSet set;
+    };
+    Shard shards_[NUM_SHARDS];
+};
+
+// Keeps every candidate scoring at least the limit-th best score seen so far (ties included),
+// which is exactly the set the selection phase keeps; everything below is dropped on arrival.
+class StreamingTopPool {
+public:
+    explicit StreamingTopPool(size_t limit) : limit_(max<size_t>(limit, 1)), cutoff_log2_(-INFINITY) {}
+
+    void add(vector<ScoredPartition>& batch) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& sp : batch) {
+            if (full_ && sp.first < cutoff_) continue;
+            entries_.push_back(std::move(sp));
+        }
+        if (entries_.size() >= 2 * limit_) compact();
+    }
+
+    // Move all entries of another pool into this one
+    void absorb(StreamingTopPool& other) {
+        vector<ScoredPartition> taken;
+        {
+            std::lock_guard<std::mutex> lock(other.mutex_);
+            taken = std::move(other.entries_);
+            other.entries_.clear();
+        }
+        add(taken);
+    }
+
+    // log2 of the current cutoff score, -inf while fewer than limit candidates were seen
+    double cutoff_log2() const { return cutoff_log2_.load(std::memory_order_relaxed); }
+
+    void finish(vector<ScoredPartition>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compact();
+        out = std::move(entries_);
+        entries_.clear();
+    }
+
+private:
+    void compact() {
+        std::sort(entries_.begin(), entries_.end(), scored_partition_greater);
+        if (entries_.size() < limit_) return;
+        cutoff_ = entries_[limit_ - 1].first;
+        full_ = true;
+        size_t keep = limit_;
+        while (keep < entries_.size() && entries_[keep].first == cutoff_) ++keep;
+        entries_.erase(entries_.begin() + keep, entries_.end());
+        cutoff_log2_.store(bigint_log2(cutoff_), std::memory_order_relaxed);
+    }
+
+    size_t limit_;
+    std::mutex mutex_;
+    vector<ScoredPartition> entries_;
+    BigInt cutoff_;
+    bool full_ = false;
+    std::atomic<double> cutoff_log2_;
+};
+
+// Expand one slice of a shake frontier by a remove/add step, keeping only results in G'
+static void expand_shake_frontier(const vector<Partition>& frontier, size_t begin, size_t end,
+                                  vector<Partition>& expanded) {
+    for (size_t i = begin; i < end; ++i) {
+        for (const auto& r : remove_box(frontier[i])) {
+            for (const auto& a : add_box(r)) {
+                if (is_in_subgraph_G_prime(a)) expanded.push_back(a);
+            }
+        }
+    }
+}
+
+// Per-level state shared by all pipeline tasks. Results are merged per worker and
+// combined only at stage boundaries, so the outcome does not depend on the thread count.
+struct PipelineLevel {
+    PipelineLevel(WorkStealingExecutor& executor, size_t pool_limit)
+        : executor(executor) {
+        for (int w = 0; w < executor.num_workers(); ++w) {
+            worker_pools.emplace_back(new StreamingTopPool(pool_limit));
+        }
+    }
+
+    WorkStealingExecutor& executor;
+    ShardedPartitionSet seen;
+    vector<std::unique_ptr<StreamingTopPool>> worker_pools;
+    std::atomic<long long> evaluated_count{0};
+    std::atomic<long long> prefiltered_count{0};
+    // Scores below 2^prefilter_log2 cannot reach the final pool (set before shaking starts)
+    double prefilter_log2 = -INFINITY;
+};
+
+static void evaluate_candidate_batch(PipelineLevel& level, const vector<Partition>& batch) {
+    vector<ScoredPartition> scored;
+    scored.reserve(batch.size());
+    StreamingTopPool& pool = *level.worker_pools[level.executor.worker_id()];
+    vector<unsigned int> hook_hist;
+    long long prefiltered = 0;
+    for (const auto& cand : batch) {
+        // The log-hook estimate is accurate to far better than the margin, so a candidate it places
+        // clearly below the cutoff would be rejected by the pool anyway: skip the exact product
+        double threshold = max(level.prefilter_log2, pool.cutoff_log2());
+        double log2_f;
+        if (threshold > -INFINITY && hook_profile(cand, hook_hist, log2_f) &&
+            log2_f + PREFILTER_MARGIN * (1.0 + std::fabs(log2_f)) < threshold) {
+            prefiltered++;
+            continue;
+        }
+        BigInt f_cand = score_partition(cand);
+        if (f_cand != -1) {
+            scored.push_back({std::move(f_cand), cand});
+        }
+    }
+    pool.add(scored);
+    if (prefiltered) level.prefiltered_count += prefiltered;
+
+    long long before = level.evaluated_count.fetch_add(batch.size());
+    if ((before + (long long)batch.size()) / 10000 != before / 10000) {
+        #pragma omp critical
+        {
+            cout << "    Evaluated " << before + batch.size() << " candidates..." << endl;
+        }
+    }
+}
+
+// Deduplicate freshly generated shapes and stream them to evaluation tasks in batches
+static void stream_new_candidates(PipelineLevel& level, const vector<Partition>& generated) {
+    std::shared_ptr<vector<Partition>> batch;
+    for (const auto& cand : generated) {
+        if (!level.seen.insert(cand)) continue;
+        if (!batch) batch = std::make_shared<vector<Partition>>();
+        batch->push_back(cand);
+        if (batch->size() == PIPELINE_EVAL_BATCH) {
+            level.executor.spawn([&level, batch] { evaluate_candidate_batch(level, *batch); });
+            batch.reset();
+        }
+    }
+    if (batch) {
+        level.executor.spawn([&level, batch] { evaluate_candidate_batch(level, *batch); });
+    }
+}
+
+// Shake one k=0 candidate up to max_k steps (same BFS as generate_shaken_candidates_upto).
+// Frontiers larger than PIPELINE_SPLIT_FRONTIER are expanded by subtasks and merged in slice order.
+static void shake_source_task(PipelineLevel& level, const Partition& source, int max_k) {
+    if (!is_in_subgraph_G_prime(source)) return;
+
+    PartitionSet visited;
+    visited.insert(source);
+    vector<Partition> frontier = {source};
+
+    for (int k = 1; k <= max_k && !frontier.empty(); ++k) {
+        size_t slices = 1;
+        if (frontier.size() > PIPELINE_SPLIT_FRONTIER && level.executor.num_workers() > 1) {
+            slices = min<size_t>((frontier.size() + PIPELINE_SPLIT_FRONTIER - 1) / PIPELINE_SPLIT_FRONTIER,
+                                 4 * level.executor.num_workers());
+        }
+        vector<vector<Partition>> expanded(slices);
+        if (slices == 1) {
+            expand_shake_frontier(frontier, 0, frontier.size(), expanded[0]);
+        } else {
+            std::atomic<long> remaining(slices);
+            size_t slice_len = (frontier.size() + slices - 1) / slices;
+            for (size_t s = 0; s < slices; ++s) {
+                size_t begin = min(frontier.size(), s * slice_len);
+                size_t end = min(frontier.size(), begin + slice_len);
+                level.executor.spawn([&frontier, &expanded, &remaining, s, begin, end] {
+                    expand_shake_frontier(frontier, begin, end, expanded[s]);
+                    remaining--;
+                });
+            }
+            level.executor.wait(remaining);
+        }
+
+        vector<Partition> next_frontier;
+        for (const auto& slice : expanded) {
+            for (const auto& a : slice) {
+                if (visited.insert(a).second) next_frontier.push_back(a);
+            }
+        }
+        stream_new_candidates(level, next_frontier);
+        frontier = std::move(next_frontier);
+    }
+}
+
+void run_pipelined_level(const vector<ScoredPartition>& pool_n, const vector<ScoredPartition>& pool_n_minus_1,
+                         const PoolHistory& history, int n, int max_shake_k, size_t pool_limit, double shake_prune_ratio,
+                         vector<ScoredPartition>& top_candidates) {
+    WorkStealingExecutor executor(omp_get_max_threads());
+    PipelineLevel level(executor, pool_limit);
+
+    // k=0 candidates from both sources; they are also the starting points for shaking
+    vector<Partition> shake_sources;
+    for (const auto& scored_p_n : pool_n) {
+        if (!is_in_subgraph_G_prime(scored_p_n.second)) {
+            cerr << "Warning: Pool partition " << partition_to_string(scored_p_n.second) << " is not in G'. Skipping initial candidate generation from it." << endl;
+            continue;
+        }
+        for (const auto& cand : add_box(scored_p_n.second)) {
+            if (is_in_subgraph_G_prime(cand) && level.seen.insert(cand)) shake_sources.push_back(cand);
+        }
+    }
+    size_t from_n_count = shake_sources.size();
+    if (n >= 2) {
+        for (const auto& scored_p_n_minus_1 : pool_n_minus_1) {
+            if (!is_in_subgraph_G_prime(scored_p_n_minus_1.second)) continue;
+            for (const auto& cand : add_two_boxes(scored_p_n_minus_1.second)) {
+                if (is_in_subgraph_G_prime(cand) && level.seen.insert(cand)) shake_sources.push_back(cand);
+            }
+        }
+    }
+    size_t from_n1_count = shake_sources.size() - from_n_count;
+
+    // Deeper history: the layer of size n-j holds the G' shapes of the depth-j pool plus the
+    // one-box extensions of the layer below. Layers are sets, so a shape reachable from several
+    // depths is expanded once; shapes already in pool_n_minus_1 or pool_n were expanded above.
+    if (history.deepest() >= 2) {
+        PartitionSet layer;
+        vector<size_t> layer_sizes;
+        for (int depth = history.deepest(); depth >= 0; --depth) {
+            PartitionSet next_layer;
+            for (const auto& p : layer) {
+                for (const auto& q : add_box(p)) {
+                    if (is_in_subgraph_G_prime(q)) next_layer.insert(q);
+                }
+            }
+            if (depth >= 2) {
+                for (const auto& sp : history.at(depth)) {
+                    if (is_in_subgraph_G_prime(sp.second)) next_layer.insert(sp.second);
+                }
+            } else {
+                for (const auto& sp : (depth == 1 ? pool_n_minus_1 : pool_n)) next_layer.erase(sp.second);
+            }
+            layer = std::move(next_layer);
+            layer_sizes.push_back(layer.size());
+        }
+        for (const auto& p : layer) {
+            for (const auto& cand : add_box(p)) {
+                if (is_in_subgraph_G_prime(cand) && level.seen.insert(cand)) shake_sources.push_back(cand);
+            }
+        }
+        cout << "  History layers (sizes " << n - history.deepest() << ".." << n << "):";
+        for (size_t s : layer_sizes) cout << " " << s;
+        cout << " -> " << shake_sources.size() - from_n_count - from_n1_count << " more k=0 candidates." << endl;
+    }
+
+    cout << "  Pipeline: " << from_n_count << " unique k=0 candidates from n, "
+         << from_n1_count << " more from n-1 (in G'), "
+         << executor.num_workers() << " workers." << endl;
+
+    // Stage 1: score the k=0 candidates; their scores fix the cutoff used for pruning
+    vector<BigInt> source_scores(shake_sources.size());
+    executor.run([&] {
+        for (size_t begin = 0; begin < shake_sources.size(); begin += PIPELINE_EVAL_BATCH) {
+            size_t end = min(shake_sources.size(), begin + PIPELINE_EVAL_BATCH);
+            executor.spawn([&, begin, end] {
+                vector<ScoredPartition> scored;
+                for (size_t i = begin; i < end; ++i) {
+                    source_scores[i] = score_partition(shake_sources[i]);
+                    if (source_scores[i] != -1) scored.push_back({source_scores[i], shake_sources[i]});
+                }
+                level.worker_pools[executor.worker_id()]->add(scored);
+                level.evaluated_count += end - begin;
+            });
+        }
+    });
+    StreamingTopPool& merged = *level.worker_pools[0];
+    for (size_t w = 1; w < level.worker_pools.size(); ++w) merged.absorb(*level.worker_pools[w]);
+    const double cutoff_log2 = merged.cutoff_log2();
+    level.prefilter_log2 = cutoff_log2;
+    const double prune_log2 = (shake_prune_ratio > 0) ? std::log2(shake_prune_ratio) : 0.0;
+
+    // Stage 2: shake every k=0 candidate; new unique shapes stream into evaluation tasks
+    long long pruned_count = 0;
+    if (max_shake_k > 0) {
+        vector<size_t> to_shake;
+        for (size_t i = 0; i < shake_sources.size(); ++i) {
+            bool pruned = shake_prune_ratio > 0 && source_scores[i] != -1 &&
+                          bigint_log2(source_scores[i]) + prune_log2 < cutoff_log2;
+            if (pruned) {
+                pruned_count++;
+            } else {
+                to_shake.push_back(i);
+            }
+        }
+        executor.run([&] {
+            for (size_t i : to_shake) {
+                executor.spawn([&, i] { shake_source_task(level, shake_sources[i], max_shake_k); });
+            }
+        });
+    }
+
+    cout << "  Pipeline: evaluated " << level.evaluated_count.load() << " unique candidates for n = " << n + 1
+         << " (" << level.prefiltered_count.load() << " rejected by the " << hook_kernel_name() << " log-hook prefilter)";
+    if (shake_prune_ratio > 0) {
+        cout << ", pruned shaking from " << pruned_count << " of " << shake_sources.size() << " k=0 candidates";
+    }
+    cout << "; " << executor.steal_count() << " tasks stolen." << endl;
+
+    for (size_t w = 1; w < level.worker_pools.size(); ++w) merged.absorb(*level.worker_pools[w]);
+    merged.finish(top_candidates);
+    cout << "  Evaluation complete. Kept " << top_candidates.size() << " top scored candidates." << endl;
+}
 
 bool is_valid_partition(const Partition& p) {
     if (p.empty()) return true;
@@ -1238,36 +2271,29 @@ bool is_valid_partition(const Partition& p) {
     return true;
 }
 
+Partition conjugate_partition(const Partition& p) {
+    Partition conj;
+    if (p.empty()) return conj;
+    conj.resize(p[0]);
+    // Rows [i, j) all of length p[i] give columns p[j]..p[i]-1 exactly j boxes
+    size_t i = 0;
+    while (i < p.size()) {
+        size_t j = i + 1;
+        while (j < p.size() && p[j] == p[i]) ++j;
+        unsigned int next_len = (j < p.size()) ? p[j] : 0;
+        std::fill(conj.begin() + next_len, conj.begin() + p[i], (unsigned int)j);
+        i = j;
+    }
+    return conj;
+}
+
 Partition get_base_symmetric_subdiagram(const Partition& p) {
      // Optimization: If partition is empty or first element is 0, return empty.
-     if (p.empty() || p[0] == 0) {
+     if (p.empty() || p[0] == 0 || !is_valid_partition(p)) {
          return Partition();
      }
 
-     // Calculate conjugate partition more carefully
-     Partition p_conj;
-     if (!p.empty()) {
-         p_conj.resize(p[0], 0); // Max possible length is p[0]
-         for (unsigned int part_len : p) {
-             for (size_t i = 0; i < part_len; ++i) {
-                 // Ensure index is within bounds before incrementing
-                 if (i < p_conj.size()) {
-                     p_conj[i]++;
-                 } else {
-                    // This case suggests an issue, maybe the initial resize wasn't enough
-                    // or the input partition 'p' might be malformed.
-                    // For safety, let's break or log an error.
-                     // cerr << "Warning: Index out of bounds during conjugate calculation for " << partition_to_string(p) << endl;
-                     break; // Stop processing this part_len
-                 }
-             }
-         }
-          // Trim trailing zeros from conjugate
-          while (!p_conj.empty() && p_conj.back() == 0) {
-              p_conj.pop_back();
-          }
-     }
-
+     Partition p_conj = conjugate_partition(p);
 
      Partition lambda_sym;
      size_t max_k = min(p.size(), p_conj.size());
@@ -1393,6 +2419,132 @@ long long hookLength(const Partition& partition, int r, int c) {
      return arm + leg + 1;
 }
 
+// --- Hook Kernels Implementation ---
+
+#if defined(__AVX512F__)
+static const char* HOOK_KERNEL_NAME = "avx512";
+#elif defined(__AVX2__)
+static const char* HOOK_KERNEL_NAME = "avx2";
+#else
+static const char* HOOK_KERNEL_NAME = "scalar";
+#endif
+
+const char* hook_kernel_name() { return HOOK_KERNEL_NAME; }
+
+// Hooks of cells c in [0, len) of row r: (len - r - 1) + conj[c] - c
+static inline void hook_row_scalar(const unsigned int* conj, unsigned int len, unsigned int r, unsigned int* out) {
+    unsigned int base = len - r - 1;
+    for (unsigned int c = 0; c < len; ++c) out[c] = base + conj[c] - c;
+}
+
+static inline void hook_row_simd(const unsigned int* conj, unsigned int len, unsigned int r, unsigned int* out) {
+    unsigned int c = 0;
+#if defined(__AVX512F__)
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i base = _mm512_sub_epi32(_mm512_set1_epi32((int)(len - r - 1)),
+                                    _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    for (; c + 16 <= len; c += 16) {
+        __m512i col = _mm512_loadu_si512((const void*)(conj + c));
+        _mm512_storeu_si512((void*)(out + c), _mm512_add_epi32(base, col));
+        base = _mm512_sub_epi32(base, step);
+    }
+    if (c < len) {
+        __mmask16 tail = (__mmask16)((1u << (len - c)) - 1);
+        __m512i col = _mm512_maskz_loadu_epi32(tail, conj + c);
+        _mm512_mask_storeu_epi32(out + c, tail, _mm512_add_epi32(base, col));
+        c = len;
+    }
+#elif defined(__AVX2__)
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i base = _mm256_sub_epi32(_mm256_set1_epi32((int)(len - r - 1)),
+                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    for (; c + 8 <= len; c += 8) {
+        __m256i col = _mm256_loadu_si256((const __m256i*)(conj + c));
+        _mm256_storeu_si256((__m256i*)(out + c), _mm256_add_epi32(base, col));
+        base = _mm256_sub_epi32(base, step);
+    }
+#endif
+    if (c < len) hook_row_scalar(conj + c, len - c, r, out + c); // The shorter length absorbs the offset c
+}
+
+bool compute_hooks(const Partition& p, vector<unsigned int>& hooks, bool force_scalar) {
+    hooks.clear();
+    if (p.empty()) return true;
+    if (!is_valid_partition(p)) return false;
+    Partition conj = conjugate_partition(p);
+    size_t n = 0;
+    for (unsigned int part : p) n += part;
+    hooks.resize(n);
+    unsigned int* out = hooks.data();
+    for (size_t r = 0; r < p.size(); ++r) {
+        if (force_scalar) hook_row_scalar(conj.data(), p[r], (unsigned int)r, out);
+        else hook_row_simd(conj.data(), p[r], (unsigned int)r, out);
+        out += p[r];
+    }
+    return true;
+}
+
+bool hook_profile(const Partition& p, vector<unsigned int>& hook_hist, double& log2_f, bool force_scalar) {
+    static thread_local vector<unsigned int> hooks;
+    if (!compute_hooks(p, hooks, force_scalar)) return false;
+    size_t n = hooks.size();
+    hook_hist.assign(n + 1, 0);
+    for (unsigned int h : hooks) hook_hist[h]++; // Hooks of a valid partition lie in [1, n]
+    double sum_log2 = 0.0;
+    for (size_t h = 2; h <= n; ++h) {
+        if (hook_hist[h]) sum_log2 += hook_hist[h] * std::log2((double)h);
+    }
+    log2_f = std::lgamma((double)n + 1.0) / M_LN2 - sum_log2;
+    return true;
+}
+
+template <size_t MaxRows, typename Word>
+static bool count_syt_fixed(const Partition& p, unsigned int n, Word& f) {
+    if (p.size() > MaxRows) return false;
+    std::array<unsigned int, MaxRows> rows{};
+    std::array<unsigned int, SMALL_KERNEL_MAX_N> conj{};
+    const size_t num_rows = p.size();
+    for (size_t r = 0; r < num_rows; ++r) {
+        rows[r] = p[r];
+        for (unsigned int c = 0; c < rows[r]; ++c) conj[c]++;
+    }
+    Word factorial = 1;
+    for (unsigned int i = 2; i <= n; ++i) factorial *= i;
+    Word product = 1; // Divides n!, so it cannot overflow either
+    for (size_t r = 0; r < num_rows; ++r) {
+        for (unsigned int c = 0; c < rows[r]; ++c) product *= rows[r] - c + conj[c] - (unsigned int)r - 1;
+    }
+    f = factorial / product;
+    return true;
+}
+
+bool count_syt_small(const Partition& p, BigInt& f) {
+    unsigned int n = 0;
+    for (unsigned int part : p) {
+        n += part;
+        if (n > SMALL_KERNEL_MAX_N) return false;
+    }
+    if (n == 0 || !is_valid_partition(p)) return false;
+
+    if (n <= SMALL_KERNEL_MAX_N_64) {
+        uint64_t word;
+        bool ok = (p.size() <= 4)  ? count_syt_fixed<4, uint64_t>(p, n, word)
+                : (p.size() <= 8)  ? count_syt_fixed<8, uint64_t>(p, n, word)
+                :                    count_syt_fixed<SMALL_KERNEL_MAX_N_64, uint64_t>(p, n, word);
+        if (ok) mpz_set_ui(f.get_mpz_t(), word);
+        return ok;
+    }
+    unsigned __int128 word;
+    bool ok = (p.size() <= 8)  ? count_syt_fixed<8, unsigned __int128>(p, n, word)
+            : (p.size() <= 16) ? count_syt_fixed<16, unsigned __int128>(p, n, word)
+            :                    count_syt_fixed<SMALL_KERNEL_MAX_N, unsigned __int128>(p, n, word);
+    if (ok) {
+        uint64_t limbs[2] = {(uint64_t)word, (uint64_t)(word >> 64)};
+        mpz_import(f.get_mpz_t(), 2, -1, sizeof(uint64_t), 0, 0, limbs);
+    }
+    return ok;
+}
+
 BigInt countSYT_gmp(const Partition& partition) {
     unsigned long n_ul = 0;
     if (partition.empty()) return 1;
@@ -1402,11 +2554,30 @@ BigInt countSYT_gmp(const Partition& partition) {
     }
     if (n_ul == 0 && !partition.empty()) { cerr << "Error (countSYT_gmp): Non-empty partition " << partition_to_string(partition) << " has size 0.\n"; return -1; }
 
+    BigInt small_f;
+    if (count_syt_small(partition, small_f)) return small_f;
+
     BigInt n_factorial;
     mpz_fac_ui(n_factorial.get_mpz_t(), n_ul);
 
     BigInt product_hook_lengths = 1;
-    try {
+    static thread_local vector<unsigned int> hook_hist;
+    double log2_f;
+    if (hook_profile(partition, hook_hist, log2_f)) {
+        // prod h^count(h): multiply hooks in machine words, flush to GMP only when a word would overflow
+        unsigned long word = 1;
+        for (size_t h = hook_hist.size(); h-- > 2; ) {
+            for (unsigned int k = 0; k < hook_hist[h]; ++k) {
+                if (word > ULONG_MAX / h) {
+                    mpz_mul_ui(product_hook_lengths.get_mpz_t(), product_hook_lengths.get_mpz_t(), word);
+                    word = 1;
+                }
+                word *= h;
+            }
+        }
+        mpz_mul_ui(product_hook_lengths.get_mpz_t(), product_hook_lengths.get_mpz_t(), word);
+    } else try {
+        // Not non-increasing: keep the cell-by-cell path and its diagnostics
         for (int r = 0; r < partition.size(); ++r) {
             for (int c = 0; c < partition[r]; ++c) {
                 long long hl = hookLength(partition, r, c);
@@ -1424,3 +2595,732 @@ BigInt countSYT_gmp(const Partition& partition) {
     } else { cerr << "Error (countSYT_gmp): n! (" << n_ul << "!) not divisible by product of hooks for partition " << partition_to_string(partition) << ".\n"; return -1; }
     return result;
 }
+
+bool check_hook_kernels(int max_size) {
+    cout << "Cross-checking the " << hook_kernel_name() << " hook kernel against the scalar kernel, hookLength"
+         << ", the small-partition kernels and the cell-by-cell f^lambda on all partitions of size <= " << max_size << "..." << endl;
+    long long checked = 0, failures = 0;
+    vector<unsigned int> simd_hooks, scalar_hooks, hist;
+    for (int n = 1; n <= max_size; ++n) {
+        // Partitions of n in reverse lexicographic order, starting from [n]
+        Partition p = {(unsigned int)n};
+        while (true) {
+            bool ok = compute_hooks(p, simd_hooks) && compute_hooks(p, scalar_hooks, true) &&
+                      simd_hooks == scalar_hooks;
+            BigInt product = 1;
+            size_t cell = 0;
+            for (int r = 0; ok && r < (int)p.size(); ++r) {
+                for (int c = 0; c < (int)p[r]; ++c, ++cell) {
+                    long long hl = hookLength(p, r, c);
+                    if (hl != (long long)simd_hooks[cell]) ok = false;
+                    product *= (unsigned long)hl;
+                }
+            }
+            BigInt reference;
+            mpz_fac_ui(reference.get_mpz_t(), n);
+            reference /= product;
+            double log2_f;
+            BigInt small_f;
+            if ((unsigned int)n <= SMALL_KERNEL_MAX_N) {
+                ok = ok && count_syt_small(p, small_f) && small_f == reference;
+            }
+            ok = ok && countSYT_gmp(p) == reference && hook_profile(p, hist, log2_f) &&
+                 std::fabs(log2_f - bigint_log2(reference)) <= PREFILTER_MARGIN * (1.0 + std::fabs(log2_f));
+            if (!ok) {
+                if (failures < 10) cerr << "Kernel mismatch for partition " << partition_to_string(p) << endl;
+                failures++;
+            }
+            checked++;
+
+            // Next partition: drop trailing 1s, decrement the last part > 1, refill with copies of it
+            unsigned int ones = 0;
+            while (!p.empty() && p.back() == 1) { p.pop_back(); ones++; }
+            if (p.empty()) break;
+            unsigned int part = --p.back();
+            unsigned int rest = ones + 1;
+            while (rest > 0) {
+                unsigned int take = min(part, rest);
+                p.push_back(take);
+                rest -= take;
+            }
+        }
+    }
+    cout << "Checked " << checked << " partitions: " << failures << " mismatches." << endl;
+    return failures == 0;
+}
+
+// --- Level Arena Implementation ---
+
+static const int LEVEL_ARENA_NUM_CLASSES = 17;        // Power-of-two classes 16 B .. 1 MiB
+static const size_t LEVEL_ARENA_MAX_BLOCK = (size_t)16 << (LEVEL_ARENA_NUM_CLASSES - 1);
+
+struct alignas(64) LevelArenaSlot {
+    char* begin = nullptr;
+    char* bump = nullptr;
+    char* end = nullptr;
+    void* free_lists[LEVEL_ARENA_NUM_CLASSES] = {};
+    LevelArenaStats stats;
+};
+
+static bool g_arena_enabled = false;
+static bool g_arena_active = false;
+static char* g_arena_base = nullptr;
+static size_t g_arena_reserved = 0;
+static LevelArenaSlot* g_arena_slots = nullptr;
+static int g_arena_num_slots = 0;
+static std::atomic<int> g_arena_next_slot{0};
+static std::atomic<unsigned long long> g_arena_overflow_requests{0}; // Threads beyond the reserved slots
+static thread_local int t_arena_slot = -1;
+
+static inline int level_arena_size_class(size_t bytes) {
+    if (bytes <= 16) return 0;
+    return 64 - __builtin_clzll((unsigned long long)(bytes - 1)) - 4;
+}
+
+static inline bool level_arena_owns(const void* p) {
+    return g_arena_base && (const char*)p >= g_arena_base && (const char*)p < g_arena_base + g_arena_reserved;
+}
+
+static inline LevelArenaSlot* level_arena_my_slot() {
+    if (t_arena_slot == -1) {
+        int slot = g_arena_next_slot.fetch_add(1);
+        t_arena_slot = (slot < g_arena_num_slots) ? slot : -2;
+    }
+    return (t_arena_slot >= 0) ? &g_arena_slots[t_arena_slot] : nullptr;
+}
+
+void level_arena_init(bool enabled, size_t slab_bytes, int max_threads) {
+    g_arena_num_slots = max(1, max_threads);
+    g_arena_slots = new LevelArenaSlot[g_arena_num_slots];
+    if (!enabled) return;
+
+    slab_bytes = (slab_bytes + 4095) & ~(size_t)4095;
+    size_t total = slab_bytes * g_arena_num_slots;
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        cerr << "Warning: Could not reserve " << (total >> 20) << " MB for the level arena. Using malloc." << endl;
+        return;
+    }
+    g_arena_base = static_cast<char*>(base);
+    g_arena_reserved = total;
+    for (int i = 0; i < g_arena_num_slots; ++i) {
+        g_arena_slots[i].begin = g_arena_base + i * slab_bytes;
+        g_arena_slots[i].bump = g_arena_slots[i].begin;
+        g_arena_slots[i].end = g_arena_slots[i].begin + slab_bytes;
+    }
+    g_arena_enabled = true;
+}
+
+void level_arena_set_active(bool active) {
+    g_arena_active = active && g_arena_enabled;
+}
+
+void level_arena_reset(bool release) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < g_arena_num_slots; ++i) {
+        LevelArenaSlot& slot = g_arena_slots[i];
+        if (release && slot.bump > slot.begin) {
+            size_t used = ((size_t)(slot.bump - slot.begin) + page - 1) & ~(page - 1);
+            madvise(slot.begin, used, MADV_DONTNEED);
+        }
+        slot.bump = slot.begin;
+        std::fill(std::begin(slot.free_lists), std::end(slot.free_lists), nullptr);
+    }
+#ifdef __GLIBC__
+    if (release) malloc_trim(0);
+#endif
+}
+
+LevelArenaStats level_arena_collect_stats(bool clear) {
+    LevelArenaStats total;
+    for (int i = 0; i < g_arena_num_slots; ++i) {
+        LevelArenaSlot& slot = g_arena_slots[i];
+        total.requests += slot.stats.requests;
+        total.recycled += slot.stats.recycled;
+        total.bumped += slot.stats.bumped;
+        total.heap += slot.stats.heap;
+        total.arena_bytes_used += slot.bump - slot.begin;
+        if (clear) slot.stats = LevelArenaStats();
+    }
+    unsigned long long overflow = clear ? g_arena_overflow_requests.exchange(0) : g_arena_overflow_requests.load();
+    total.requests += overflow;
+    total.heap += overflow;
+    return total;
+}
+
+void* level_arena_allocate(size_t bytes) {
+    LevelArenaSlot* slot = level_arena_my_slot();
+    if (!slot) {
+        g_arena_overflow_requests++;
+        return malloc(bytes);
+    }
+    slot->stats.requests++;
+
+    if (g_arena_active && bytes <= LEVEL_ARENA_MAX_BLOCK) {
+        int cls = level_arena_size_class(bytes);
+        void* head = slot->free_lists[cls];
+        if (head) {
+            slot->free_lists[cls] = *static_cast<void**>(head);
+            slot->stats.recycled++;
+            return head;
+        }
+        size_t block = (size_t)16 << cls;
+        if ((size_t)(slot->end - slot->bump) >= block) {
+            void* p = slot->bump;
+            slot->bump += block;
+            slot->stats.bumped++;
+            return p;
+        }
+    }
+    slot->stats.heap++;
+    return malloc(bytes);
+}
+
+void level_arena_deallocate(void* p, size_t bytes) {
+    if (!p) return;
+    if (!level_arena_owns(p)) {
+        free(p);
+        return;
+    }
+    // Arena blocks go to the freeing thread's list; threads without a slot just drop them until the reset
+    LevelArenaSlot* slot = level_arena_my_slot();
+    if (!slot) return;
+    int cls = level_arena_size_class(bytes);
+    *static_cast<void**>(p) = slot->free_lists[cls];
+    slot->free_lists[cls] = p;
+}
+
+void* gmp_level_alloc(size_t bytes) {
+    void* p = level_arena_allocate(bytes);
+    if (!p) {
+        cerr << "Error: GMP allocation of " << bytes << " bytes failed." << endl;
+        abort();
+    }
+    return p;
+}
+
+void* gmp_level_realloc(void* p, size_t old_bytes, size_t new_bytes) {
+    if (!level_arena_owns(p)) {
+        // Heap blocks stay on the heap so that long-lived values never migrate into the arena
+        void* q = realloc(p, new_bytes);
+        if (!q) {
+            cerr << "Error: GMP reallocation of " << new_bytes << " bytes failed." << endl;
+            abort();
+        }
+        return q;
+    }
+    if (new_bytes <= LEVEL_ARENA_MAX_BLOCK && level_arena_size_class(old_bytes) == level_arena_size_class(new_bytes)) {
+        return p;
+    }
+    void* q = gmp_level_alloc(new_bytes);
+    memcpy(q, p, min(old_bytes, new_bytes));
+    level_arena_deallocate(p, old_bytes);
+    return q;
+}
+
+void gmp_level_free(void* p, size_t bytes) {
+    level_arena_deallocate(p, bytes);
+}
+
+// --- Persistent Score Cache ---
+// File layout: header page, open-addressed slot table, then an append-only data region of
+// records [num_parts][parts...][f^lambda as raw little-endian 64-bit limbs]. Processes hold a
+// shared flock while they read during a level and an exclusive one while they append the
+// level's new scores (and, if the file is full, compact it keeping the most recently used half).
+
+static const char SCORE_CACHE_MAGIC[8] = {'F', 'L', 'C', 'A', 'C', 'H', 'E', '1'};
+static const uint64_t SCORE_CACHE_HEADER_BYTES = 4096;
+static const uint64_t SCORE_CACHE_BYTES_PER_SLOT = 256; // Expected data bytes per entry, sizes the table
+
+struct ScoreCacheHeader {
+    char magic[8];
+    uint64_t num_slots;   // Power of two
+    uint64_t data_begin;  // Offset of the data region
+    uint64_t data_end;    // File size
+    uint64_t data_tail;   // Next free byte in the data region
+    uint64_t num_entries;
+    uint64_t epoch;       // Bumped by every process that opens the cache
+};
+
+struct ScoreCacheSlot {
+    uint64_t hash;        // 0 = empty
+    uint64_t offset;      // Record offset
+    uint32_t length;      // Record length in bytes
+    uint32_t last_used;   // Epoch of the last hit
+    double log_f;         // Natural log of f^lambda
+};
+
+struct PendingScore {
+    uint64_t hash;
+    std::vector<uint32_t> parts;
+    std::vector<unsigned char> limbs;
+    double log_f;
+};
+
+static int g_cache_fd = -1;
+static char* g_cache_map = nullptr;
+static size_t g_cache_map_bytes = 0;
+static uint32_t g_cache_epoch = 0;
+static std::mutex g_cache_pending_mutex;
+static std::vector<PendingScore> g_cache_pending;
+static std::atomic<unsigned long long> g_cache_hits{0};
+static std::atomic<unsigned long long> g_cache_misses{0};
+
+static inline ScoreCacheHeader* score_cache_header() {
+    return reinterpret_cast<ScoreCacheHeader*>(g_cache_map);
+}
+
+static inline ScoreCacheSlot* score_cache_slots() {
+    return reinterpret_cast<ScoreCacheSlot*>(g_cache_map + SCORE_CACHE_HEADER_BYTES);
+}
+
+uint64_t partition_cache_hash(const Partition& p) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ p.size();
+    for (unsigned int part : p) {
+        h ^= part + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+        h *= 0xFF51AFD7ED558CCDULL;
+    }
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+bool score_cache_open(const string& path, long long size_mb) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        cerr << "Warning: Could not open score cache '" << path << "'. Running without it." << endl;
+        return false;
+    }
+    flock(fd, LOCK_EX);
+
+    struct stat st;
+    fstat(fd, &st);
+    size_t file_bytes = st.st_size;
+    if (file_bytes == 0) {
+        // New cache: size the slot table for the requested limit and leave the rest for data
+        uint64_t total = (uint64_t)size_mb << 20;
+        uint64_t slots = 1;
+        while (slots * (sizeof(ScoreCacheSlot) + SCORE_CACHE_BYTES_PER_SLOT) < total) slots <<= 1;
+        slots >>= 1;
+        ScoreCacheHeader header;
+        memcpy(header.magic, SCORE_CACHE_MAGIC, sizeof(header.magic));
+        header.num_slots = max<uint64_t>(slots, 1024);
+        header.data_begin = SCORE_CACHE_HEADER_BYTES + header.num_slots * sizeof(ScoreCacheSlot);
+        header.data_end = max(total, header.data_begin + (header.num_slots << 6));
+        header.data_tail = header.data_begin;
+        header.num_entries = 0;
+        header.epoch = 0;
+        if (ftruncate(fd, header.data_end) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            cerr << "Warning: Could not initialize score cache '" << path << "'. Running without it." << endl;
+            flock(fd, LOCK_UN);
+            close(fd);
+            return false;
+        }
+        file_bytes = header.data_end;
+    }
+
+    void* map = mmap(nullptr, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED || memcmp(static_cast<ScoreCacheHeader*>(map)->magic, SCORE_CACHE_MAGIC, 8) != 0 ||
+        static_cast<ScoreCacheHeader*>(map)->data_end != file_bytes) {
+        cerr << "Warning: '" << path << "' is not a valid score cache. Running without it." << endl;
+        if (map != MAP_FAILED) munmap(map, file_bytes);
+        flock(fd, LOCK_UN);
+        close(fd);
+        return false;
+    }
+    g_cache_fd = fd;
+    g_cache_map = static_cast<char*>(map);
+    g_cache_map_bytes = file_bytes;
+    g_cache_epoch = (uint32_t)++score_cache_header()->epoch;
+    flock(fd, LOCK_UN);
+
+    ScoreCacheHeader* header = score_cache_header();
+    cout << "Using score cache '" << path << "': " << header->num_entries << " entries, "
+         << ((header->data_tail - header->data_begin) >> 20) << " of " << ((header->data_end - header->data_begin) >> 20)
+         << " MB data used." << endl;
+    return true;
+}
+
+void score_cache_begin_level() {
+    if (g_cache_fd < 0) return;
+    flock(g_cache_fd, LOCK_SH);
+}
+
+// Slot holding p, or nullptr. Caller holds a lock on the file.
+static ScoreCacheSlot* score_cache_find(const Partition& p, uint64_t hash) {
+    ScoreCacheHeader* header = score_cache_header();
+    ScoreCacheSlot* slots = score_cache_slots();
+    uint64_t mask = header->num_slots - 1;
+    for (uint64_t i = hash & mask, probes = 0; probes < header->num_slots; i = (i + 1) & mask, ++probes) {
+        ScoreCacheSlot& slot = slots[i];
+        if (slot.hash == 0) return nullptr;
+        if (slot.hash != hash) continue;
+        const uint32_t* record = reinterpret_cast<const uint32_t*>(g_cache_map + slot.offset);
+        if (record[0] == p.size() && std::equal(p.begin(), p.end(), record + 1)) return &slot;
+    }
+    return nullptr;
+}
+
+bool score_cache_lookup(const Partition& p, BigInt& f) {
+    if (g_cache_fd < 0) return false;
+    ScoreCacheSlot* slot = score_cache_find(p, partition_cache_hash(p));
+    if (!slot) {
+        g_cache_misses++;
+        return false;
+    }
+    const char* record = g_cache_map + slot->offset;
+    size_t header_bytes = sizeof(uint32_t) * (1 + p.size());
+    mpz_import(f.get_mpz_t(), (slot->length - header_bytes) / 8, -1, 8, -1, 0, record + header_bytes);
+    __atomic_store_n(&slot->last_used, g_cache_epoch, __ATOMIC_RELAXED);
+    g_cache_hits++;
+    return true;
+}
+
+void score_cache_record(const Partition& p, const BigInt& f) {
+    if (g_cache_fd < 0 || f <= 0) return;
+    PendingScore pending;
+    pending.hash = partition_cache_hash(p);
+    pending.parts.assign(p.begin(), p.end());
+    size_t limbs = (mpz_sizeinbase(f.get_mpz_t(), 2) + 63) / 64;
+    pending.limbs.resize(limbs * 8);
+    size_t written = 0;
+    mpz_export(pending.limbs.data(), &written, -1, 8, -1, 0, f.get_mpz_t());
+    pending.limbs.resize(written * 8);
+    pending.log_f = bigint_log2(f) * M_LN2;
+    std::lock_guard<std::mutex> lock(g_cache_pending_mutex);
+    g_cache_pending.push_back(std::move(pending));
+}
+
+// Drop the least recently used entries until both the table and the data region are at most half full.
+// Caller holds the exclusive lock.
+static unsigned long long score_cache_compact() {
+    ScoreCacheHeader* header = score_cache_header();
+    ScoreCacheSlot* slots = score_cache_slots();
+
+    vector<ScoreCacheSlot> live;
+    for (uint64_t i = 0; i < header->num_slots; ++i) {
+        if (slots[i].hash != 0) live.push_back(slots[i]);
+    }
+    std::sort(live.begin(), live.end(), [](const ScoreCacheSlot& a, const ScoreCacheSlot& b) {
+        return a.last_used > b.last_used;
+    });
+
+    uint64_t data_budget = (header->data_end - header->data_begin) / 2;
+    uint64_t slot_budget = header->num_slots / 2;
+    std::vector<char> kept_data;
+    vector<ScoreCacheSlot> kept;
+    for (const auto& slot : live) {
+        if (kept.size() >= slot_budget || kept_data.size() + slot.length > data_budget) break;
+        ScoreCacheSlot moved = slot;
+        moved.offset = header->data_begin + kept_data.size();
+        kept_data.insert(kept_data.end(), g_cache_map + slot.offset, g_cache_map + slot.offset + slot.length);
+        kept_data.resize((kept_data.size() + 7) & ~(size_t)7);
+        kept.push_back(moved);
+    }
+
+    memset(slots, 0, header->num_slots * sizeof(ScoreCacheSlot));
+    memcpy(g_cache_map + header->data_begin, kept_data.data(), kept_data.size());
+    uint64_t mask = header->num_slots - 1;
+    for (const auto& slot : kept) {
+        uint64_t i = slot.hash & mask;
+        while (slots[i].hash != 0) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+    header->data_tail = header->data_begin + kept_data.size();
+    header->num_entries = kept.size();
+    return live.size() - kept.size();
+}
+
+void score_cache_end_level() {
+    if (g_cache_fd < 0) return;
+    flock(g_cache_fd, LOCK_UN);
+
+    std::vector<PendingScore> pending;
+    {
+        std::lock_guard<std::mutex> lock(g_cache_pending_mutex);
+        pending.swap(g_cache_pending);
+    }
+
+    unsigned long long inserted = 0, evicted = 0;
+    if (!pending.empty()) {
+        flock(g_cache_fd, LOCK_EX);
+        ScoreCacheHeader* header = score_cache_header();
+        ScoreCacheSlot* slots = score_cache_slots();
+        uint64_t mask = header->num_slots - 1;
+        for (const auto& entry : pending) {
+            Partition p(entry.parts.begin(), entry.parts.end());
+            if (score_cache_find(p, entry.hash)) continue; // Another process (or thread) got there first
+
+            uint32_t length = sizeof(uint32_t) * (1 + entry.parts.size()) + entry.limbs.size();
+            if (header->data_tail + length > header->data_end || 4 * (header->num_entries + 1) > 3 * header->num_slots) {
+                evicted += score_cache_compact();
+                if (header->data_tail + length > header->data_end) continue; // Larger than the whole cache
+            }
+
+            char* record = g_cache_map + header->data_tail;
+            uint32_t num_parts = entry.parts.size();
+            memcpy(record, &num_parts, sizeof(num_parts));
+            memcpy(record + sizeof(uint32_t), entry.parts.data(), sizeof(uint32_t) * num_parts);
+            memcpy(record + sizeof(uint32_t) * (1 + num_parts), entry.limbs.data(), entry.limbs.size());
+
+            uint64_t i = entry.hash & mask;
+            while (slots[i].hash != 0) i = (i + 1) & mask;
+            slots[i].offset = header->data_tail;
+            slots[i].length = length;
+            slots[i].last_used = g_cache_epoch;
+            slots[i].log_f = entry.log_f;
+            __atomic_store_n(&slots[i].hash, entry.hash, __ATOMIC_RELEASE);
+
+            header->data_tail += (length + 7) & ~7u;
+            header->num_entries++;
+            inserted++;
+        }
+        flock(g_cache_fd, LOCK_UN);
+    }
+
+    cout << "  Score cache: " << g_cache_hits.exchange(0) << " hits, " << g_cache_misses.exchange(0) << " misses, "
+         << inserted << " inserted, " << evicted << " evicted (" << score_cache_header()->num_entries << " entries)." << endl;
+}
+
+static std::atomic<unsigned long long> g_level_scorings{0};
+
+unsigned long long take_level_scoring_count() {
+    return g_level_scorings.exchange(0);
+}
+
+BigInt score_partition(const Partition& p) {
+    g_level_scorings++;
+    if (g_cache_fd < 0) return countSYT_gmp(p);
+
+    // f^lambda = f^{lambda'}, so key the cache by min(lambda, lambda') and let either shape hit the
+    // entry. (Within one G' search both never appear: outside the symmetric core G' only allows
+    // boxes strictly below the diagonal, so a conjugate pair can share the cache only across runs
+    // with different constraints or callers.)
+    Partition conj = conjugate_partition(p);
+    const Partition& canonical = (conj < p) ? conj : p;
+
+    BigInt f;
+    if (!score_cache_lookup(canonical, f)) {
+        f = countSYT_gmp(canonical);
+        score_cache_record(canonical, f);
+    }
+    return f;
+}
+
+// --- c(lambda) Record Stream Implementation ---
+
+static std::ofstream c_lambda_stream;
+static const char C_LAMBDA_STREAM_MAGIC[8] = {'D', 'I', 'M', 'L', 'C', 'L', 'S', '1'};
+static const unsigned long C_LAMBDA_OUTPUT_BITS = 64; // The updater prints c(lambda) with 16 decimals
+static const unsigned long C_LAMBDA_GUARD_BITS = 32;
+static const unsigned long C_LAMBDA_MPF_BITS = 512;   // The updater's default mpf precision
+
+double compute_c_lambda(const BigInt& f, unsigned long n) {
+    if (sgn(f) <= 0) return NAN;
+
+    double log_n_factorial = std::lgamma((double)n + 1.0);
+    mpfr_prec_t prec = C_LAMBDA_OUTPUT_BITS + C_LAMBDA_GUARD_BITS +
+                       (mpfr_prec_t)std::ceil(std::log2(log_n_factorial + 2.0));
+
+    // Leading prec bits of f^lambda
+    mpz_class top;
+    size_t bits = mpz_sizeinbase(f.get_mpz_t(), 2);
+    unsigned long shift = 0;
+    if (bits > (size_t)prec) {
+        shift = (unsigned long)(bits - prec);
+        mpz_tdiv_q_2exp(top.get_mpz_t(), f.get_mpz_t(), shift);
+    } else {
+        top = f;
+    }
+
+    mpfr_t log_f, term, sqrt_n;
+    mpfr_init2(log_f, prec);
+    mpfr_init2(term, prec);
+    mpfr_init2(sqrt_n, prec);
+
+    // log f = log(top) + shift * log 2
+    mpfr_set_z(log_f, top.get_mpz_t(), MPFR_RNDN);
+    mpfr_log(log_f, log_f, MPFR_RNDN);
+    if (shift > 0) {
+        mpfr_const_log2(term, MPFR_RNDN);
+        mpfr_mul_ui(term, term, shift, MPFR_RNDN);
+        mpfr_add(log_f, log_f, term, MPFR_RNDN);
+    }
+
+    // c = (lngamma(n+1) / 2 - log f) / sqrt(n)
+    mpfr_set_ui(term, n, MPFR_RNDN);
+    mpfr_add_ui(term, term, 1, MPFR_RNDN);
+    mpfr_lngamma(term, term, MPFR_RNDN);
+    mpfr_div_2ui(term, term, 1, MPFR_RNDN);
+    mpfr_sub(term, term, log_f, MPFR_RNDN);
+    mpfr_set_ui(sqrt_n, n, MPFR_RNDN);
+    mpfr_sqrt(sqrt_n, sqrt_n, MPFR_RNDN);
+    mpfr_div(term, term, sqrt_n, MPFR_RNDN);
+
+    // Through an mpf, as the updater converts it (mpf_get_d truncates)
+    mpf_class result(0, C_LAMBDA_MPF_BITS);
+    mpfr_get_f(result.get_mpf_t(), term, MPFR_RNDN);
+
+    mpfr_clear(log_f);
+    mpfr_clear(term);
+    mpfr_clear(sqrt_n);
+    return result.get_d();
+}
+
+bool c_lambda_stream_open(const string& path, bool restart) {
+    struct stat st;
+    bool fresh = restart || stat(path.c_str(), &st) != 0 || st.st_size == 0;
+    c_lambda_stream.open(path, (restart ? std::ios_base::trunc : std::ios_base::app) | std::ios_base::out |
+                         std::ios_base::binary);
+    if (!c_lambda_stream) return false;
+    if (fresh) {
+        c_lambda_stream.write(C_LAMBDA_STREAM_MAGIC, sizeof(C_LAMBDA_STREAM_MAGIC));
+    }
+    cout << (restart ? "Writing c(lambda) records to " : "Appending c(lambda) records to ") << path << endl;
+    return true;
+}
+
+bool c_lambda_stream_active() {
+    return c_lambda_stream.is_open();
+}
+
+int64_t results_text_position(std::ofstream& out) {
+    if (!c_lambda_stream_active() || !out.is_open()) return -1;
+    out.flush();
+    return (int64_t)out.tellp();
+}
+
+void c_lambda_stream_write(unsigned long n, const BigInt& f, const Partition& p, int64_t digits_begin, int64_t digits_end) {
+    if (!c_lambda_stream_active()) return;
+
+    uint64_t header[4] = {(uint64_t)n, 0, 0, 0};
+    double c = compute_c_lambda(f, n);
+    std::memcpy(&header[1], &c, sizeof(c));
+    if (digits_begin >= 0 && digits_end > digits_begin) {
+        header[2] = (uint64_t)digits_begin;
+        header[3] = (uint64_t)(digits_end - digits_begin);
+    }
+    uint32_t counts[2] = {(uint32_t)p.size(), 0};
+    vector<int32_t> parts(p.begin(), p.end());
+    if (parts.size() % 2) parts.push_back(0);
+
+    c_lambda_stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    c_lambda_stream.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    c_lambda_stream.write(reinterpret_cast<const char*>(parts.data()), parts.size() * sizeof(int32_t));
+    c_lambda_stream.flush();
+    cout << "  c(lambda) for n = " << n << ": " << std::fixed << std::setprecision(16) << c << endl;
+    cout.unsetf(std::ios_base::floatfield);
+    cout << std::setprecision(6);
+}
+
+// --- Adaptive Budget Implementation ---
+
+double current_rss_mb() {
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    unsigned long long total_pages = 0, resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        return (double)(resident_pages * (unsigned long long)sysconf(_SC_PAGESIZE)) / 1048576.0;
+    }
+#endif
+    // Fall back to the peak, which only overestimates the current footprint
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1048576.0;
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+void AdaptiveBudget::plan_next_level(int n_done, double seconds, unsigned long long candidates, double rss_mb,
+                                     size_t pool_filled, int& store_n, int& store_n1, int& shake_k) {
+    if (!enabled()) return;
+
+    // Cost per candidate grows with n (longer hooks, bigger integers). Extrapolate one level
+    // ahead from the trend of the last two levels, bounded so that one noisy level cannot
+    // throw the settings around.
+    double per_candidate = seconds / (double)max(1ULL, candidates);
+    double growth = (prev_per_candidate > 0) ? std::max(1.0, std::min(1.5, per_candidate / prev_per_candidate)) : 1.0;
+    prev_per_candidate = per_candidate;
+    double predicted = seconds * growth;
+
+    int old_store_n = store_n, old_shake_k = shake_k;
+    string reason;
+
+    if (level_seconds > 0) {
+        // Aim at 90% of the budget; candidates scale roughly linearly with the pool size
+        double ratio = 0.9 * level_seconds / std::max(predicted, 1e-3);
+        if (ratio < 0.25 && shake_k > 0) {
+            shake_k--;
+            reason = "predicted time far over budget";
+        } else if (ratio > 8 && shake_k < shake_ceiling) {
+            shake_k++;
+            reason = "predicted time far under budget";
+        } else if (ratio < 1) {
+            // Shrink from the size the pool actually reached, not from a limit it never hit
+            int filled = (int)min<size_t>(pool_filled, store_n);
+            store_n = max(1, min(store_n, (int)std::lround(filled * std::max(0.5, ratio))));
+            reason = "predicted time over budget";
+        } else if (pool_filled >= (size_t)store_n) {
+            // Growing only helps once the pool is saturated
+            store_n = (int)std::min(4.0e7, std::round(store_n * std::min(2.0, ratio)));
+            reason = "predicted time under budget";
+        }
+    }
+
+    if (memory_mb > 0) {
+        // The pools and the levels' working memory scale with store-n and shake; the baseline does
+        // not. The arena is released between levels, so resident memory comes down after a cut.
+        double target_mb = 0.9 * memory_mb;
+        double room_mb = target_mb - baseline_mb;
+        double footprint_mb = std::max(rss_mb - baseline_mb, 1e-3);
+        // A cut shows two levels later (the next level still grows from a pool of the old size); one
+        // that did not shrink the footprint will not help the next time either
+        if (memory_cut_n > 0 && n_done >= memory_cut_n + 2) {
+            if (footprint_mb >= 0.9 * memory_cut_footprint_mb) memory_cuts_useless = true;
+            memory_cut_n = 0;
+        }
+        if (rss_mb <= target_mb) memory_cuts_useless = false;
+        if (rss_mb > target_mb && room_mb > 0 && !memory_cuts_useless && memory_cut_n == 0) {
+            // Shrink from the size the pool actually reached, in proportion to the excess
+            double ratio = room_mb / footprint_mb;
+            int filled = (int)min<size_t>(pool_filled, store_n);
+            store_n = max(1, min(store_n, (int)std::lround(filled * std::max(0.5, ratio))));
+            if (rss_mb > 0.97 * memory_mb && ratio < 0.5 && shake_k > 0) shake_k = min(shake_k, old_shake_k - 1);
+            reason = "resident memory near the ceiling";
+            memory_cut_n = n_done;
+            memory_cut_footprint_mb = footprint_mb;
+        } else if (rss_mb > target_mb) {
+            cout << std::fixed << std::setprecision(2) << "  Adaptive: resident memory near the ceiling, but "
+                 << (room_mb <= 0 ? "the process alone takes 90% of it"
+                     : memory_cut_n > 0 ? "the last cut has not taken effect yet"
+                                        : "the last cut did not shrink the footprint")
+                 << " (" << baseline_mb << " MB at the start, " << footprint_mb << " MB since)" << endl;
+            cout.unsetf(std::ios_base::floatfield);
+        } else if (level_seconds == 0 && store_n < store_n_ceiling && pool_filled >= (size_t)store_n &&
+                   baseline_mb + 2 * footprint_mb < target_mb) {
+            // Without a time budget, grow back towards --store-n and --shake while memory allows
+            // (doubling the pool at most doubles the footprint)
+            store_n = min(store_n_ceiling, 2 * store_n);
+            reason = "resident memory well under the ceiling";
+        } else if (level_seconds == 0 && store_n >= store_n_ceiling && shake_k < shake_ceiling &&
+                   baseline_mb + 4 * footprint_mb < target_mb) {
+            shake_k++;
+            reason = "resident memory well under the ceiling";
+        }
+    }
+
+    store_n1 = max(1, (int)std::lround(store_n * pool_ratio_n1));
+
+    cout << std::fixed << std::setprecision(2)
+         << "  Adaptive: n = " << n_done << " took " << seconds << " s for " << candidates << " candidates, RSS "
+         << rss_mb << " MB; next level predicted " << predicted << " s at current settings";
+    cout.unsetf(std::ios_base::floatfield);
+    if (store_n != old_store_n || shake_k != old_shake_k) {
+        cout << " -> " << reason << ": store-n " << old_store_n << " -> " << store_n
+             << ", store-n1 -> " << store_n1 << ", shake " << old_shake_k << " -> " << shake_k;
+    } else {
+        cout << " -> keeping store-n " << store_n << ", store-n1 " << store_n1 << ", shake " << shake_k;
+    }
+    cout << endl;
+}
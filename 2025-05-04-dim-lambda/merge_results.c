@@ -0,0 +1,447 @@
+/**
+ * Heuristic Results Merger
+ *
+ * This program merges several heuristic_results.txt files (for example from runs
+ * on different machines with different --shake / --store-n settings) into one.
+ * The inputs are streamed block by block in a k-way merge by size, so only the
+ * current block of every input is held in memory. For each size the merged file
+ * keeps the strictly largest f^lambda, the union of the maximizers on ties, and
+ * the files that achieved it. The f^lambda values are compared as decimal
+ * strings (by length, then lexicographically) without being parsed.
+
+ COMPILE COMMAND:
+ clang -o merge_results merge_results.c -O2
+
+ USAGE:
+ ./merge_results [--binary] <output_file> <input_1> <input_2> [...]
+
+ The text output has the heuristic_results.txt layout (plus a "Sources:" line per
+ size, which heuristic_dim_lambda and partition_updater ignore), so it can be
+ resumed from or fed to partition_updater. Merging merged files keeps their sources.
+
+ With --binary the output is a binary store instead: the 8-byte magic "DIMLMRG1",
+ then one record per size (host byte order):
+   uint32 size, uint32 partition count, uint64 digit count, the digits of f^lambda,
+   per partition: uint32 part count and the uint32 parts,
+   uint32 length of the sources text and the text (comma separated file names).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define BINARY_MAGIC "DIMLMRG1"
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuffer;
+
+typedef struct {
+    const char *path;
+    FILE *file;
+    char *line;
+    size_t line_cap;
+    unsigned long pending_size; /* Size header read ahead while finishing the previous block */
+    int has_pending;
+    unsigned long last_size;
+
+    /* Current block */
+    int has_block;
+    unsigned long size;
+    int has_dimension;          /* 0 for "N/A" or missing values */
+    TextBuffer dimension;       /* Digits of Max f^lambda */
+    TextBuffer partitions;      /* Text after "Partitions achieving maximum: " */
+    TextBuffer sources;         /* "Sources:" line of a merged input, else empty */
+} ResultReader;
+
+/**
+ * Replace the contents of a buffer with len bytes of text (kept NUL-terminated)
+ */
+int buffer_set(TextBuffer *buf, const char *text, size_t len) {
+    if (len + 1 > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap : 64;
+        while (new_cap < len + 1) new_cap *= 2;
+        char *new_data = (char *)realloc(buf->data, new_cap);
+        if (!new_data) {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            return 0;
+        }
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data, text, len);
+    buf->data[len] = '\0';
+    buf->len = len;
+    return 1;
+}
+
+/**
+ * Empty a buffer (its storage is kept for the next size)
+ */
+void buffer_clear(TextBuffer *buf) {
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+/**
+ * Append len bytes of text to a buffer
+ */
+int buffer_append(TextBuffer *buf, const char *text, size_t len) {
+    size_t old_len = buf->len;
+    if (old_len + len + 1 > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap : 64;
+        while (new_cap < old_len + len + 1) new_cap *= 2;
+        char *new_data = (char *)realloc(buf->data, new_cap);
+        if (!new_data) {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            return 0;
+        }
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + old_len, text, len);
+    buf->len = old_len + len;
+    buf->data[buf->len] = '\0';
+    return 1;
+}
+
+/**
+ * Length of a line without its trailing newline / carriage return
+ */
+size_t trimmed_length(const char *line, size_t len) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+    return len;
+}
+
+/**
+ * Compare two non-negative decimal strings: by length after leading zeros, then digit by digit
+ */
+int compare_decimal(const char *a, size_t a_len, const char *b, size_t b_len) {
+    while (a_len > 1 && *a == '0') { a++; a_len--; }
+    while (b_len > 1 && *b == '0') { b++; b_len--; }
+    if (a_len != b_len) return (a_len < b_len) ? -1 : 1;
+    int cmp = memcmp(a, b, a_len);
+    return (cmp > 0) - (cmp < 0);
+}
+
+/**
+ * Read the next "--- Size n ---" block of an input; returns 0 at end of file
+ */
+int reader_next_block(ResultReader *reader) {
+    ssize_t read_len;
+    reader->has_block = 0;
+
+    /* Find the size header (it may already have been read as the end of the last block) */
+    while (!reader->has_pending) {
+        read_len = getline(&reader->line, &reader->line_cap, reader->file);
+        if (read_len < 0) return 0;
+        if (sscanf(reader->line, "--- Size %lu ---", &reader->pending_size) == 1) {
+            reader->has_pending = 1;
+        }
+    }
+
+    reader->size = reader->pending_size;
+    reader->has_pending = 0;
+    reader->has_dimension = 0;
+    buffer_clear(&reader->dimension);
+    buffer_clear(&reader->partitions);
+    buffer_clear(&reader->sources);
+
+    while ((read_len = getline(&reader->line, &reader->line_cap, reader->file)) >= 0) {
+        char *line = reader->line;
+        size_t len = trimmed_length(line, (size_t)read_len);
+
+        if (sscanf(line, "--- Size %lu ---", &reader->pending_size) == 1) {
+            reader->has_pending = 1;
+            break;
+        }
+        if (strncmp(line, "Max f^lambda: ", 14) == 0) {
+            const char *start = line + 14;
+            size_t digits = 0;
+            while (start + digits < line + len && start[digits] >= '0' && start[digits] <= '9') digits++;
+            reader->has_dimension = digits > 0;
+            if (!buffer_set(&reader->dimension, start, digits)) return 0;
+        } else if (strncmp(line, "Partitions achieving maximum: ", 30) == 0) {
+            if (!buffer_set(&reader->partitions, line + 30, len - 30)) return 0;
+        } else if (strncmp(line, "Sources: ", 9) == 0) {
+            if (!buffer_set(&reader->sources, line + 9, len - 9)) return 0;
+        }
+    }
+
+    reader->has_block = 1;
+    return 1;
+}
+
+/**
+ * Advance a reader to its next block with a size above the last one it produced
+ */
+void reader_advance(ResultReader *reader) {
+    while (reader_next_block(reader)) {
+        if (reader->last_size == 0 || reader->size > reader->last_size) {
+            reader->last_size = reader->size;
+            return;
+        }
+        fprintf(stderr, "Warning: '%s' lists size %lu after size %lu; skipping the out-of-order block.\n",
+                reader->path, reader->size, reader->last_size);
+    }
+}
+
+/**
+ * Append the comma separated items of list to merged unless already present; returns the item count
+ * added. Items are "[...]" partitions when bracketed is set, else comma separated names.
+ */
+size_t merge_list(TextBuffer *merged, const char *list, size_t list_len, int bracketed) {
+    size_t added = 0;
+    size_t i = 0;
+    while (i < list_len) {
+        while (i < list_len && (list[i] == ' ' || list[i] == ',')) i++;
+        if (i >= list_len) break;
+        size_t start = i;
+        if (bracketed) {
+            if (list[i] != '[') break;
+            while (i < list_len && list[i] != ']') i++;
+            if (i < list_len) i++;
+        } else {
+            while (i < list_len && list[i] != ',') i++;
+        }
+        size_t item_len = i - start;
+        while (item_len > 0 && list[start + item_len - 1] == ' ') item_len--;
+        if (item_len == 0) continue;
+
+        /* Linear search: ties rarely have more than a handful of maximizers */
+        int found = 0;
+        size_t j = 0;
+        while (j < merged->len && !found) {
+            while (j < merged->len && (merged->data[j] == ' ' || merged->data[j] == ',')) j++;
+            size_t other = j;
+            if (bracketed) {
+                while (j < merged->len && merged->data[j] != ']') j++;
+                if (j < merged->len) j++;
+            } else {
+                while (j < merged->len && merged->data[j] != ',') j++;
+            }
+            size_t other_len = j - other;
+            while (other_len > 0 && merged->data[other + other_len - 1] == ' ') other_len--;
+            found = (other_len == item_len && memcmp(merged->data + other, list + start, item_len) == 0);
+        }
+        if (!found) {
+            if (merged->len > 0) buffer_append(merged, ", ", 2);
+            buffer_append(merged, list + start, item_len);
+            added++;
+        }
+    }
+    return added;
+}
+
+/**
+ * Write one merged size to the binary store
+ */
+int write_binary_record(FILE *out, unsigned long size, const TextBuffer *dimension,
+                        const TextBuffer *partitions, size_t partition_count, const TextBuffer *sources) {
+    uint32_t size32 = (uint32_t)size;
+    uint32_t count32 = (uint32_t)partition_count;
+    uint64_t digits = dimension->len;
+    fwrite(&size32, sizeof(size32), 1, out);
+    fwrite(&count32, sizeof(count32), 1, out);
+    fwrite(&digits, sizeof(digits), 1, out);
+    fwrite(dimension->data, 1, dimension->len, out);
+
+    /* Parts of each "[a, b, ...]" item */
+    const char *p = partitions->data;
+    const char *end = partitions->data + partitions->len;
+    uint32_t *parts = NULL;
+    size_t parts_cap = 0;
+    while (p < end) {
+        const char *open = memchr(p, '[', end - p);
+        if (!open) break;
+        const char *close = memchr(open, ']', end - open);
+        if (!close) break;
+        uint32_t num_parts = 0;
+        const char *q = open + 1;
+        while (q < close) {
+            char *next;
+            unsigned long part = strtoul(q, &next, 10);
+            if (next == q) { q++; continue; }
+            if (num_parts == parts_cap) {
+                parts_cap = parts_cap ? 2 * parts_cap : 64;
+                uint32_t *new_parts = (uint32_t *)realloc(parts, parts_cap * sizeof(uint32_t));
+                if (!new_parts) {
+                    fprintf(stderr, "Error: Memory allocation failed.\n");
+                    free(parts);
+                    return 0;
+                }
+                parts = new_parts;
+            }
+            parts[num_parts++] = (uint32_t)part;
+            q = next;
+        }
+        fwrite(&num_parts, sizeof(num_parts), 1, out);
+        fwrite(parts, sizeof(uint32_t), num_parts, out);
+        p = close + 1;
+    }
+    free(parts);
+
+    uint32_t sources_len = (uint32_t)sources->len;
+    fwrite(&sources_len, sizeof(sources_len), 1, out);
+    fwrite(sources->data, 1, sources->len, out);
+    return !ferror(out);
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--binary] <output_file> <input_1> <input_2> [...]\n", program_name);
+    fprintf(stderr, "  --binary: write a binary store instead of a heuristic_results.txt style file\n");
+    fprintf(stderr, "  <output_file>: merged results (must not be one of the inputs)\n");
+    fprintf(stderr, "  <input_k>: heuristic_results.txt files to merge\n");
+}
+
+int main(int argc, char *argv[]) {
+    int binary = 0;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--binary") == 0) {
+        binary = 1;
+        arg++;
+    }
+    if (argc - arg < 2) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *output_file = argv[arg++];
+    int num_inputs = argc - arg;
+    ResultReader *readers = (ResultReader *)calloc(num_inputs, sizeof(ResultReader));
+    if (!readers) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < num_inputs; i++) {
+        readers[i].path = argv[arg + i];
+        if (strcmp(readers[i].path, output_file) == 0) {
+            fprintf(stderr, "Error: Output file '%s' is also an input.\n", output_file);
+            return EXIT_FAILURE;
+        }
+        readers[i].file = fopen(readers[i].path, "r");
+        if (!readers[i].file) {
+            fprintf(stderr, "Error: Could not open input file '%s'.\n", readers[i].path);
+            return EXIT_FAILURE;
+        }
+        reader_advance(&readers[i]);
+    }
+
+    FILE *out = fopen(output_file, binary ? "wb" : "w");
+    if (!out) {
+        fprintf(stderr, "Error: Could not open output file '%s' for writing.\n", output_file);
+        return EXIT_FAILURE;
+    }
+    if (binary) {
+        fwrite(BINARY_MAGIC, 1, 8, out);
+    } else {
+        fprintf(out, "Heuristic search results (merged from %d files:", num_inputs);
+        for (int i = 0; i < num_inputs; i++) fprintf(out, "%s %s", i ? "," : "", readers[i].path);
+        fprintf(out, ") for partitions maximizing f^lambda (SYT count)\n");
+        fprintf(out, "-------------------------------------------------------------------------------------------------------------------\n");
+    }
+
+    TextBuffer best_partitions = {0}, best_sources = {0}, best_dimension = {0};
+    int blocks_written = 0;
+    unsigned long improved_sizes = 0;
+    while (1) {
+        /* Smallest pending size across the inputs */
+        int have_any = 0;
+        unsigned long size = 0;
+        for (int i = 0; i < num_inputs; i++) {
+            if (readers[i].has_block && (!have_any || readers[i].size < size)) {
+                size = readers[i].size;
+                have_any = 1;
+            }
+        }
+        if (!have_any) break;
+
+        int best = -1;
+        int contributors = 0;
+        size_t partition_count = 0;
+        for (int i = 0; i < num_inputs; i++) {
+            ResultReader *reader = &readers[i];
+            if (!reader->has_block || reader->size != size) continue;
+            contributors++;
+            if (!reader->has_dimension) continue;
+
+            int cmp = (best < 0) ? 1 : compare_decimal(reader->dimension.data, reader->dimension.len,
+                                                       best_dimension.data, best_dimension.len);
+            if (cmp > 0) {
+                best = i;
+                buffer_set(&best_dimension, reader->dimension.data, reader->dimension.len);
+                buffer_clear(&best_partitions);
+                buffer_clear(&best_sources);
+                partition_count = 0;
+            }
+            if (cmp >= 0) {
+                partition_count += merge_list(&best_partitions, reader->partitions.data, reader->partitions.len, 1);
+                if (reader->sources.len > 0) {
+                    merge_list(&best_sources, reader->sources.data, reader->sources.len, 0);
+                } else {
+                    merge_list(&best_sources, reader->path, strlen(reader->path), 0);
+                }
+            }
+        }
+        if (best >= 0 && contributors > 1) {
+            /* Count sizes where some input was beaten */
+            for (int i = 0; i < num_inputs; i++) {
+                if (readers[i].has_block && readers[i].size == size && readers[i].has_dimension &&
+                    compare_decimal(readers[i].dimension.data, readers[i].dimension.len,
+                                    best_dimension.data, best_dimension.len) < 0) {
+                    improved_sizes++;
+                    break;
+                }
+            }
+        }
+
+        if (binary) {
+            if (best >= 0 && !write_binary_record(out, size, &best_dimension, &best_partitions,
+                                                  partition_count, &best_sources)) {
+                fprintf(stderr, "Error: Failed to write binary record for size %lu.\n", size);
+                fclose(out);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(out, "%s--- Size %lu ---\n", blocks_written ? "\n" : "", size);
+            if (best < 0) {
+                fprintf(out, "Max f^lambda: N/A (No valid candidates found/evaluated)\n");
+            } else {
+                fprintf(out, "Max f^lambda: %s (achieved by %zu partition%s in G')\n",
+                        best_dimension.data, partition_count, partition_count == 1 ? "" : "s");
+                fprintf(out, "Partitions achieving maximum: %s\n", best_partitions.data ? best_partitions.data : "");
+                fprintf(out, "Sources: %s\n", best_sources.data ? best_sources.data : "");
+            }
+        }
+        blocks_written++;
+
+        for (int i = 0; i < num_inputs; i++) {
+            if (readers[i].has_block && readers[i].size == size) reader_advance(&readers[i]);
+        }
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: Failed to write output file '%s'.\n", output_file);
+        return EXIT_FAILURE;
+    }
+    printf("Merged %d sizes from %d files into %s (%lu sizes where the inputs disagreed).\n",
+           blocks_written, num_inputs, output_file, improved_sizes);
+
+    for (int i = 0; i < num_inputs; i++) {
+        fclose(readers[i].file);
+        free(readers[i].line);
+        free(readers[i].dimension.data);
+        free(readers[i].partitions.data);
+        free(readers[i].sources.data);
+    }
+    free(readers);
+    free(best_partitions.data);
+    free(best_sources.data);
+    free(best_dimension.data);
+    return EXIT_SUCCESS;
+}
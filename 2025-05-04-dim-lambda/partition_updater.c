@@ -6,22 +6,68 @@
  * with the new data when the dimension is greater than what's currently stored.
 
  COMPILE COMMAND:
- clang -o partition_updater partition_updater.c -lgmp -lmpfr -lm -O2 -I/opt/homebrew/include -L/opt/homebrew/lib
+ clang -o partition_updater partition_updater.c -lgmp -lmpfr -lm -lpthread -O2 -I/opt/homebrew/include -L/opt/homebrew/lib
 
  USAGE:
- ./partition_updater heuristic_results.txt output.json
+ ./partition_updater [--exact-c-lambda | --verify-c-lambda] [--threads=T] [--binary-sidecar]
+                     [--c-lambda-stream=records.bin] [--analytics=shape.bin] heuristic_results.txt output.json
+
+ By default c(lambda) is computed from lngamma(n+1) and the leading bits of f^lambda
+ at a precision chosen for the printed digits. --exact-c-lambda uses the original
+ exact n! path; --verify-c-lambda computes both, stores the exact value and reports
+ any difference. --threads=T prepares batches of sizes (parsing, comparison,
+ c(lambda)) on T threads and stores them in input order; the output is the same.
+
+ The JSON is written to output.json.tmp and renamed over output.json. Entries not
+ changed in this run are copied byte for byte from the previous file, and
+ output.json.idx lists each entry's size n, byte offset and length. --binary-sidecar
+ also writes output.json.bin (partitions, c(lambda) and the dimensions as raw limbs)
+ for readers that map it instead of parsing decimals.
+
+ --c-lambda-stream=records.bin reads the records heuristic_dim_lambda appends with the
+ same option: c(lambda) computed in the search and the position of each level's digits
+ in heuristic_results.txt, which are compared and stored as text without conversion.
+ A record is only taken if its digits sit under the "--- Size n ---" line of its size and
+ its partition is the first one listed below them.
+ With --exact-c-lambda or --verify-c-lambda the recorded c(lambda) is not used: the
+ digits of a size that grows are converted and c(lambda) is computed in that mode.
+
+ --analytics=shape.bin writes, for every stored size, the rescaled profile's sup-distance
+ to the Vershik-Kerov/Logan-Shepp curve (and where it is attained), the first row and
+ length over sqrt(n), and the first four moments, one column per quantity (on --threads
+ threads). Pass /dev/null as the text file to refresh them without new results.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <gmp.h>
 #include <mpfr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
-#define MAX_LINE_LENGTH 1048576  /* 1 MB buffer for line reading */
 #define MAX_PARTITION_SIZE 1024
 #define DEFAULT_GMP_PRECISION 512
+#define C_LAMBDA_OUTPUT_BITS 64      /* c_lambda is stored as a double printed with 16 decimals */
+#define C_LAMBDA_JSON_FORMAT "%.16f"
+#define C_LAMBDA_GUARD_BITS 32
+#define MAX_THREADS 256
+#define BLOCKS_PER_THREAD 16         /* Batch size per worker thread in parallel mode */
+#define JSON_INDEX_MAGIC "DIMLIDX1"
+#define BINARY_SIDECAR_MAGIC "DIMLBIN1"
+#define C_LAMBDA_STREAM_MAGIC "DIMLCLS1"
+
+typedef enum { C_LAMBDA_FAST, C_LAMBDA_EXACT, C_LAMBDA_VERIFY } CLambdaMode;
+static CLambdaMode c_lambda_mode = C_LAMBDA_FAST;
+static unsigned long c_lambda_verified = 0, c_lambda_mismatches = 0;
+static double c_lambda_max_diff = 0.0;
+static pthread_mutex_t c_lambda_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int write_binary_sidecar = 0;
 
 typedef struct {
     char *dimension;
@@ -33,14 +79,24 @@ typedef struct {
 typedef struct {
     char *key;
     PartitionEntry *entry;
+    int dirty;             // Set or replaced since loading: serialized again on output
+    long src_offset;       // Byte range of the entry's text in the loaded file (-1: none)
+    long src_length;
 } JsonEntry;
 
 typedef struct {
-    JsonEntry **entries;
+    JsonEntry **entries;   // In insertion order (the output order)
     int size;
     int capacity;
+    int *index_by_n;       // Keys are sizes n: entries position of key n, or -1
+    unsigned long index_capacity;
+    char *source_path;     // File the object was loaded from, with its size and mtime then
+    long long source_size;
+    long long source_mtime_ns;
 } JsonObject;
 
+#define MAX_INDEXED_KEY 100000000UL  /* Larger (or non-numeric) keys fall back to a linear scan */
+
 /**
  * Calculate c(lambda) = -log(f^lambda / sqrt(n!)) / sqrt(n)
  * Using pure MPFR for high-precision calculation throughout
@@ -114,60 +170,140 @@ void compute_c_lambda(mpf_t c_lambda_result, const mpz_t f_lambda, unsigned long
 }
 
 /**
- * Parse a partition string like "[1, 2, 3]" into an array
+ * Calculate c(lambda) = (lngamma(n+1)/2 - log f^lambda) / sqrt(n) without n!.
+ * log f^lambda comes from its leading bits: f = top * 2^shift with top exact in prec bits.
+ * The working precision covers the printed digits plus the bits cancelled in the
+ * subtraction (both terms are about n log n).
  */
-int *parse_partition_string(const char *partition_str, int *partition_size) {
-    // Find the start and end of the partition array
-    const char *start = strchr(partition_str, '[');
-    if (!start) {
-        fprintf(stderr, "Error: Invalid partition string format (missing '[').\n");
-        return NULL;
+void compute_c_lambda_fast(mpf_t c_lambda_result, const mpz_t f_lambda, unsigned long int n) {
+    if (mpz_sgn(f_lambda) <= 0) {
+        fprintf(stderr, "Warning: Ratio <= 0, cannot compute logarithm. Setting c_lambda to NaN.\n");
+        mpf_set_d(c_lambda_result, NAN);
+        return;
     }
 
-    const char *end = strchr(start, ']');
-    if (!end) {
-        fprintf(stderr, "Error: Invalid partition string format (missing ']').\n");
-        return NULL;
+    double log_n_factorial = lgamma((double)n + 1.0);
+    mpfr_prec_t prec = C_LAMBDA_OUTPUT_BITS + C_LAMBDA_GUARD_BITS +
+                       (mpfr_prec_t)ceil(log2(log_n_factorial + 2.0));
+
+    // Leading prec bits of f^lambda
+    mpz_t top;
+    mpz_init(top);
+    size_t bits = mpz_sizeinbase(f_lambda, 2);
+    unsigned long shift = 0;
+    if (bits > (size_t)prec) {
+        shift = (unsigned long)(bits - prec);
+        mpz_tdiv_q_2exp(top, f_lambda, shift);
+    } else {
+        mpz_set(top, f_lambda);
     }
 
-    // Copy the partition content without brackets for parsing
-    char *partition_content = (char *)malloc(end - start);
-    if (!partition_content) {
-        fprintf(stderr, "Error: Memory allocation failed.\n");
-        return NULL;
+    mpfr_t log_f, term, sqrt_n;
+    mpfr_init2(log_f, prec);
+    mpfr_init2(term, prec);
+    mpfr_init2(sqrt_n, prec);
+
+    // log f = log(top) + shift * log 2
+    mpfr_set_z(log_f, top, MPFR_RNDN);
+    mpfr_log(log_f, log_f, MPFR_RNDN);
+    if (shift > 0) {
+        mpfr_const_log2(term, MPFR_RNDN);
+        mpfr_mul_ui(term, term, shift, MPFR_RNDN);
+        mpfr_add(log_f, log_f, term, MPFR_RNDN);
     }
 
-    strncpy(partition_content, start + 1, end - start - 1);
-    partition_content[end - start - 1] = '\0';
+    // log sqrt(n!) = lngamma(n+1) / 2
+    mpfr_set_ui(term, n, MPFR_RNDN);
+    mpfr_add_ui(term, term, 1, MPFR_RNDN);
+    mpfr_lngamma(term, term, MPFR_RNDN);
+    mpfr_div_2ui(term, term, 1, MPFR_RNDN);
+
+    // c = (log sqrt(n!) - log f) / sqrt(n)
+    mpfr_sub(term, term, log_f, MPFR_RNDN);
+    mpfr_set_ui(sqrt_n, n, MPFR_RNDN);
+    mpfr_sqrt(sqrt_n, sqrt_n, MPFR_RNDN);
+    mpfr_div(term, term, sqrt_n, MPFR_RNDN);
+    mpfr_get_f(c_lambda_result, term, MPFR_RNDN);
+
+    mpz_clear(top);
+    mpfr_clear(log_f);
+    mpfr_clear(term);
+    mpfr_clear(sqrt_n);
+}
 
-    // Count the number of commas to determine array size
-    int count = 1;
-    for (char *p = partition_content; *p; p++) {
-        if (*p == ',') count++;
+/**
+ * Calculate c(lambda) in the mode selected on the command line
+ */
+void compute_c_lambda_selected(mpf_t c_lambda_result, const mpz_t f_lambda, unsigned long int n) {
+    if (c_lambda_mode == C_LAMBDA_FAST) {
+        compute_c_lambda_fast(c_lambda_result, f_lambda, n);
+        return;
     }
 
-    // Allocate memory for the partition array
-    int *partition = (int *)malloc(count * sizeof(int));
-    if (!partition) {
-        fprintf(stderr, "Error: Memory allocation failed.\n");
-        free(partition_content);
-        return NULL;
+    compute_c_lambda(c_lambda_result, f_lambda, n);
+    if (c_lambda_mode == C_LAMBDA_VERIFY) {
+        mpf_t fast;
+        mpf_init(fast);
+        compute_c_lambda_fast(fast, f_lambda, n);
+        double exact_d = mpf_get_d(c_lambda_result), fast_d = mpf_get_d(fast);
+        double diff = fabs(exact_d - fast_d);
+        pthread_mutex_lock(&c_lambda_stats_mutex);
+        c_lambda_verified++;
+        if (diff > c_lambda_max_diff) c_lambda_max_diff = diff;
+        if (exact_d != fast_d && !(isnan(exact_d) && isnan(fast_d))) {
+            c_lambda_mismatches++;
+            fprintf(stderr, "Warning: n=%lu: fast c(lambda) %.17g differs from exact %.17g\n", n, fast_d, exact_d);
+        }
+        pthread_mutex_unlock(&c_lambda_stats_mutex);
+        mpf_clear(fast);
     }
+}
 
-    // Parse each comma-separated value
-    char *token = strtok(partition_content, ",");
-    int i = 0;
-    while (token && i < count) {
-        // Trim leading/trailing spaces
-        while (*token == ' ') token++;
+// Input file mapped privately: the parser may write a temporary NUL after a token
+typedef struct {
+    char *data;
+    size_t size;
+} MappedFile;
 
-        partition[i++] = atoi(token);
-        token = strtok(NULL, ",");
+/**
+ * Memory-map a file copy-on-write. An empty file maps to data = NULL, size = 0.
+ */
+int map_file(const char *filename, MappedFile *mapped) {
+    mapped->data = NULL;
+    mapped->size = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 1;
     }
 
-    *partition_size = i;
-    free(partition_content);
-    return partition;
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    mapped->data = (char *)data;
+    mapped->size = (size_t)st.st_size;
+    return 1;
+}
+
+// Modification time in nanoseconds, used to recognize a file we wrote or loaded
+long long stat_mtime_ns(const struct stat *st) {
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+void unmap_file(MappedFile *mapped) {
+    if (mapped->data) munmap(mapped->data, mapped->size);
+    mapped->data = NULL;
+    mapped->size = 0;
 }
 
 // Initialize a new JSON object
@@ -177,6 +313,11 @@ JsonObject *json_object_new() {
 
     obj->capacity = 16;  // Initial capacity
     obj->size = 0;
+    obj->index_by_n = NULL;
+    obj->index_capacity = 0;
+    obj->source_path = NULL;
+    obj->source_size = -1;
+    obj->source_mtime_ns = -1;
     obj->entries = (JsonEntry **)malloc(obj->capacity * sizeof(JsonEntry *));
 
     if (!obj->entries) {
@@ -214,20 +355,59 @@ void json_object_free(JsonObject *obj) {
     }
 
     free(obj->entries);
+    free(obj->index_by_n);
+    free(obj->source_path);
     free(obj);
 }
 
-// Get an entry from a JSON object by key
-PartitionEntry *json_object_get(JsonObject *obj, const char *key) {
-    if (!obj || !key) return NULL;
+// Parse a key written as a size n ("0" or digits without a leading zero); 0 if it is not one
+static int json_key_to_n(const char *key, unsigned long *n) {
+    if (!key[0] || (key[0] == '0' && key[1])) return 0;
+    unsigned long value = 0;
+    for (const char *p = key; *p; p++) {
+        if (*p < '0' || *p > '9') return 0;
+        value = value * 10 + (unsigned long)(*p - '0');
+        if (value > MAX_INDEXED_KEY) return 0;
+    }
+    *n = value;
+    return 1;
+}
 
+// Position of key in obj->entries, or -1: O(1) for size keys, a linear scan for any other key
+static int json_object_find(JsonObject *obj, const char *key) {
+    unsigned long n;
+    if (json_key_to_n(key, &n)) {
+        return (n < obj->index_capacity) ? obj->index_by_n[n] : -1;
+    }
     for (int i = 0; i < obj->size; i++) {
-        if (strcmp(obj->entries[i]->key, key) == 0) {
-            return obj->entries[i]->entry;
-        }
+        if (strcmp(obj->entries[i]->key, key) == 0) return i;
     }
+    return -1;
+}
 
-    return NULL;
+// Record that entries[position] holds key (no-op for keys that are not sizes)
+static int json_object_index(JsonObject *obj, const char *key, int position) {
+    unsigned long n;
+    if (!json_key_to_n(key, &n)) return 1;
+    if (n >= obj->index_capacity) {
+        unsigned long new_capacity = obj->index_capacity ? obj->index_capacity : 64;
+        while (new_capacity <= n) new_capacity *= 2;
+        int *new_index = (int *)realloc(obj->index_by_n, new_capacity * sizeof(int));
+        if (!new_index) return 0;
+        for (unsigned long i = obj->index_capacity; i < new_capacity; i++) new_index[i] = -1;
+        obj->index_by_n = new_index;
+        obj->index_capacity = new_capacity;
+    }
+    obj->index_by_n[n] = position;
+    return 1;
+}
+
+// Get an entry from a JSON object by key
+PartitionEntry *json_object_get(JsonObject *obj, const char *key) {
+    if (!obj || !key) return NULL;
+
+    int position = json_object_find(obj, key);
+    return (position >= 0) ? obj->entries[position]->entry : NULL;
 }
 
 // Set or update an entry in a JSON object
@@ -235,13 +415,13 @@ int json_object_set(JsonObject *obj, const char *key, PartitionEntry *entry) {
     if (!obj || !key || !entry) return 0;
 
     // Check if key already exists
-    for (int i = 0; i < obj->size; i++) {
-        if (strcmp(obj->entries[i]->key, key) == 0) {
-            // Replace existing entry
-            partition_entry_free(obj->entries[i]->entry);
-            obj->entries[i]->entry = entry;
-            return 1;
-        }
+    int position = json_object_find(obj, key);
+    if (position >= 0) {
+        // Replace existing entry
+        partition_entry_free(obj->entries[position]->entry);
+        obj->entries[position]->entry = entry;
+        obj->entries[position]->dirty = 1;
+        return 1;
     }
 
     // Check if we need to expand the array
@@ -264,175 +444,1273 @@ int json_object_set(JsonObject *obj, const char *key, PartitionEntry *entry) {
     }
 
     new_entry->entry = entry;
+    new_entry->dirty = 1;
+    new_entry->src_offset = -1;
+    new_entry->src_length = 0;
+    if (!json_object_index(obj, key, obj->size)) {
+        free(new_entry->key);
+        free(new_entry);
+        return 0;
+    }
     obj->entries[obj->size++] = new_entry;
 
     return 1;
 }
 
-// Load a JSON object from file
+// Tokenizer state over a mapped JSON text: [p, end), with base the start of the file
+typedef struct {
+    const char *base;
+    const char *p;
+    const char *end;
+} JsonCursor;
+
+static void json_skip_space(JsonCursor *c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) c->p++;
+}
+
+// Skip whitespace and consume ch
+static int json_accept(JsonCursor *c, char ch) {
+    json_skip_space(c);
+    if (c->p < c->end && *c->p == ch) {
+        c->p++;
+        return 1;
+    }
+    return 0;
+}
+
+// A string token as a slice of the mapping (escapes are kept as written)
+static int json_string(JsonCursor *c, const char **start, size_t *len) {
+    if (!json_accept(c, '"')) return 0;
+    const char *s = c->p;
+    while (c->p < c->end && *c->p != '"') {
+        if (*c->p == '\\') c->p++;
+        c->p++;
+    }
+    if (c->p >= c->end) return 0;
+    *start = s;
+    *len = (size_t)(c->p - s);
+    c->p++;
+    return 1;
+}
+
+// A number token, converted from a bounded local copy (the mapping is not NUL-terminated)
+static int json_number(JsonCursor *c, double *value) {
+    json_skip_space(c);
+    char buf[64];
+    size_t len = 0;
+    while (c->p < c->end && len < sizeof(buf) - 1 && strchr("+-0123456789.eE", *c->p) && *c->p) {
+        buf[len++] = *c->p++;
+    }
+    buf[len] = '\0';
+    char *parsed_end;
+    *value = strtod(buf, &parsed_end);
+    return len > 0 && parsed_end == buf + len;
+}
+
+// Skip any value (string, number, literal, array or object)
+static int json_skip_value(JsonCursor *c) {
+    json_skip_space(c);
+    if (c->p >= c->end) return 0;
+    if (*c->p == '"') {
+        const char *s;
+        size_t len;
+        return json_string(c, &s, &len);
+    }
+    if (*c->p == '{' || *c->p == '[') {
+        char close = (*c->p == '{') ? '}' : ']';
+        c->p++;
+        if (json_accept(c, close)) return 1;
+        do {
+            if (close == '}') {
+                const char *s;
+                size_t len;
+                if (!json_string(c, &s, &len) || !json_accept(c, ':')) return 0;
+            }
+            if (!json_skip_value(c)) return 0;
+        } while (json_accept(c, ','));
+        return json_accept(c, close);
+    }
+    const char *s = c->p;
+    while (c->p < c->end && !strchr(",}] \t\r\n", *c->p)) c->p++;
+    return c->p > s;
+}
+
+// An array of integers, parsed into the growing scratch buffer *parts
+static int json_int_array(JsonCursor *c, int **parts, int *capacity, int *count) {
+    *count = 0;
+    if (!json_accept(c, '[')) return 0;
+    if (json_accept(c, ']')) return 1;
+    do {
+        json_skip_space(c);
+        long value = 0;
+        int digits = 0;
+        while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+            value = value * 10 + (*c->p++ - '0');
+            digits++;
+        }
+        if (!digits || value > INT32_MAX) return 0;
+        if (*count == *capacity) {
+            int grown = *capacity ? 2 * *capacity : MAX_PARTITION_SIZE;
+            int *buffer = (int *)realloc(*parts, grown * sizeof(int));
+            if (!buffer) return 0;
+            *parts = buffer;
+            *capacity = grown;
+        }
+        (*parts)[(*count)++] = (int)value;
+    } while (json_accept(c, ','));
+    return json_accept(c, ']');
+}
+
+// One entry object { "dimension": "...", "partition": [...], "c_lambda": x } in any field
+// order, with unknown fields skipped
+static int json_entry_value(JsonCursor *c, PartitionEntry *entry, int **parts, int *capacity) {
+    if (!json_accept(c, '{')) return 0;
+    if (json_accept(c, '}')) return 1;
+    do {
+        const char *field;
+        size_t field_len;
+        if (!json_string(c, &field, &field_len) || !json_accept(c, ':')) return 0;
+
+        if (field_len == 9 && memcmp(field, "dimension", 9) == 0) {
+            const char *value;
+            size_t len;
+            if (!json_string(c, &value, &len)) return 0;
+            free(entry->dimension);
+            entry->dimension = (char *)malloc(len + 1);
+            if (!entry->dimension) {
+                fprintf(stderr, "Error: Memory allocation failed for dimension.\n");
+                return 0;
+            }
+            memcpy(entry->dimension, value, len);
+            entry->dimension[len] = '\0';
+        } else if (field_len == 9 && memcmp(field, "partition", 9) == 0) {
+            int count;
+            if (!json_int_array(c, parts, capacity, &count)) return 0;
+            free(entry->partition);
+            entry->partition = (int *)malloc((count ? count : 1) * sizeof(int));
+            if (!entry->partition) return 0;
+            memcpy(entry->partition, *parts, count * sizeof(int));
+            entry->partition_size = count;
+        } else if (field_len == 8 && memcmp(field, "c_lambda", 8) == 0) {
+            if (!json_number(c, &entry->c_lambda)) return 0;
+        } else if (!json_skip_value(c)) {
+            return 0;
+        }
+    } while (json_accept(c, ','));
+    return json_accept(c, '}');
+}
+
+/**
+ * Load a JSON object of entries from file (a missing or empty file gives an empty object).
+ * One pass over the mapped file, independent of line breaks and field order; only the
+ * dimension strings are copied. Returns NULL on malformed input, so it is never overwritten.
+ */
 JsonObject *json_load_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
         // File doesn't exist, create a new object
         return json_object_new();
     }
 
+    MappedFile mapped;
+    if (!map_file(filename, &mapped)) {
+        fprintf(stderr, "Error: Could not map JSON file '%s'.\n", filename);
+        return NULL;
+    }
+
     JsonObject *obj = json_object_new();
     if (!obj) {
-        fclose(file);
+        unmap_file(&mapped);
         return NULL;
     }
 
-    char line[MAX_LINE_LENGTH];
-    char current_key[32] = {0};
-    PartitionEntry *current_entry = NULL;
-    int parsing_object = 0;
-
-    // Simple JSON parser (assumes well-formed JSON)
-    while (fgets(line, sizeof(line), file)) {
-        // Trim whitespace
-        char *trimmed = line;
-        while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
-
-        // Check for object start/end
-        if (strstr(trimmed, "{")) {
-            if (strstr(trimmed, "\"")) {
-                // Extract key
-                char *key_start = strchr(trimmed, '"') + 1;
-                char *key_end = strchr(key_start, '"');
-                if (key_start && key_end) {
-                    strncpy(current_key, key_start, key_end - key_start);
-                    current_key[key_end - key_start] = '\0';
-
-                    // Create new entry
-                    current_entry = (PartitionEntry *)malloc(sizeof(PartitionEntry));
-                    if (current_entry) {
-                        current_entry->dimension = NULL;
-                        current_entry->partition = NULL;
-                        current_entry->partition_size = 0;
-                        current_entry->c_lambda = 0.0;
-                        parsing_object = 1;
-                    }
+    // Remember which file this is, so unchanged entries can be copied from it on output
+    obj->source_path = strdup(filename);
+    obj->source_size = (long long)st.st_size;
+    obj->source_mtime_ns = stat_mtime_ns(&st);
+
+    JsonCursor c = {mapped.data, mapped.data, mapped.data + mapped.size};
+    int *parts = NULL;      // Scratch buffer for partition arrays, reused by every entry
+    int parts_capacity = 0;
+    int ok = 1;
+
+    json_skip_space(&c);
+    if (c.p < c.end) {
+        ok = json_accept(&c, '{');
+        if (ok && !json_accept(&c, '}')) {
+            do {
+                // The entry's text starts at its line (or, in a reflowed file, at its key)
+                json_skip_space(&c);
+                const char *entry_start = c.p;
+                while (entry_start > c.base && (entry_start[-1] == ' ' || entry_start[-1] == '\t')) entry_start--;
+                if (entry_start > c.base && entry_start[-1] != '\n') entry_start = c.p;
+
+                const char *key;
+                size_t key_len;
+                if (!json_string(&c, &key, &key_len) || !json_accept(&c, ':')) {
+                    ok = 0;
+                    break;
                 }
-            }
-        } else if (strstr(trimmed, "}")) {
-            if (parsing_object && current_entry) {
-                // Add entry to object
-                json_object_set(obj, current_key, current_entry);
-
-                // Reset for next entry
-                memset(current_key, 0, sizeof(current_key));
-                current_entry = NULL;
-                parsing_object = 0;
-            }
-        } else if (parsing_object && current_entry) {
-            // Check for "dimension"
-            if (strstr(trimmed, "\"dimension\"")) {
-                char *value_start = strchr(trimmed, ':') + 1;
-                while (*value_start == ' ' || *value_start == '\t') value_start++;
-
-                if (*value_start == '"') {
-                    value_start++;
-                    char *value_end = strchr(value_start, '"');
-                    if (value_end) {
-                        size_t len = value_end - value_start;
-                        // Make sure we allocate enough space and don't truncate
-                        current_entry->dimension = (char *)malloc(len + 1);
-                        if (current_entry->dimension) {
-                            memcpy(current_entry->dimension, value_start, len);
-                            current_entry->dimension[len] = '\0';
-                            // We've successfully read the dimension
-                        } else {
-                            fprintf(stderr, "Error: Memory allocation failed for dimension.\n");
-                        }
-                    }
+
+                PartitionEntry *entry = (PartitionEntry *)calloc(1, sizeof(PartitionEntry));
+                char *key_str = (char *)malloc(key_len + 1);
+                if (!entry || !key_str || !json_entry_value(&c, entry, &parts, &parts_capacity)) {
+                    free(key_str);
+                    if (entry) partition_entry_free(entry);
+                    ok = 0;
+                    break;
                 }
-            }
-            // Check for "partition"
-            else if (strstr(trimmed, "\"partition\"")) {
-                char *array_start = strchr(trimmed, '[');
-                char *array_end = strrchr(trimmed, ']');
-
-                if (array_start && array_end) {
-                    // Extract array as string
-                    char array_str[MAX_LINE_LENGTH];
-                    int len = array_end - array_start + 1;
-                    if (len < MAX_LINE_LENGTH) {
-                        strncpy(array_str, array_start, len);
-                        array_str[len] = '\0';
-
-                        // Parse partition
-                        current_entry->partition = parse_partition_string(array_str,
-                                                                     &current_entry->partition_size);
-                    }
+                memcpy(key_str, key, key_len);
+                key_str[key_len] = '\0';
+
+                // Add entry to object; a complete entry is clean and its text is reused on output
+                int complete = entry->dimension && entry->partition;
+                json_object_set(obj, key_str, entry);
+                int position = json_object_find(obj, key_str);
+                if (complete && position >= 0) {
+                    JsonEntry *loaded = obj->entries[position];
+                    loaded->dirty = 0;
+                    loaded->src_offset = (long)(entry_start - c.base);
+                    loaded->src_length = (long)(c.p - entry_start);
                 }
-            }
-            // Check for "c_lambda"
-            else if (strstr(trimmed, "\"c_lambda\"")) {
-                char *value_start = strchr(trimmed, ':') + 1;
-                while (*value_start == ' ' || *value_start == '\t') value_start++;
+                free(key_str);
+            } while (json_accept(&c, ','));
+            ok = ok && json_accept(&c, '}');
+        }
+        json_skip_space(&c);
+        ok = ok && c.p == c.end;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: Malformed JSON in '%s' at byte %ld.\n", filename, (long)(c.p - c.base));
+        json_object_free(obj);
+        obj = NULL;
+    }
+    free(parts);
+    unmap_file(&mapped);
+    return obj;
+}
+
+// Write path + suffix into buf
+static int sidecar_path(char *buf, size_t buf_size, const char *path, const char *suffix) {
+    return snprintf(buf, buf_size, "%s%s", path, suffix) < (int)buf_size;
+}
+
+// Finish a temp file: flush, sync and rename it over the target
+static int commit_temp_file(FILE *file, const char *temp_path, const char *path) {
+    int ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * c(lambda) as the JSON stores it: printed with C_LAMBDA_JSON_FORMAT and read back, so an entry
+ * computed in this run carries the same value as after a reload
+ */
+double json_rounded_c_lambda(double c_lambda) {
+    if (!isfinite(c_lambda)) return c_lambda;
+    char buf[512]; // %f of a large value prints all its integer digits
+    snprintf(buf, sizeof(buf), C_LAMBDA_JSON_FORMAT, c_lambda);
+    return strtod(buf, NULL);
+}
+
+// Binary sidecar <file>.bin for memory-mapped readers:
+//   header: magic "DIMLBIN1", uint64 JSON size, uint64 JSON mtime (ns), uint64 record count,
+//           uint64 offset of the record table
+//   records (8-byte aligned): uint64 n, double c_lambda, uint32 part count, uint32 limb count
+//           high word, int32 parts (padded to 8 bytes), uint64 limb count, the limbs of the
+//           dimension (64-bit, least significant first)
+//   table: per record uint64 n, uint64 offset, uint64 length
+// Records of entries unchanged since loading (changed[i] == 0) are copied from the previous
+// sidecar if that was written alongside the loaded JSON (loaded_size, loaded_mtime_ns); only
+// changed dimensions are converted. c_lambda is always the value the JSON text holds.
+int binary_sidecar_write(JsonObject *obj, const char *filename, const char *changed,
+                         long long loaded_size, long long loaded_mtime_ns) {
+    char bin_path[4096], bin_temp_path[4096];
+    if (!sidecar_path(bin_path, sizeof(bin_path), filename, ".bin") ||
+        !sidecar_path(bin_temp_path, sizeof(bin_temp_path), filename, ".bin.tmp")) {
+        return 0;
+    }
 
-                current_entry->c_lambda = atof(value_start);
+    // Previous sidecar, usable only if it describes the JSON file this object was loaded from
+    MappedFile previous = {NULL, 0};
+    const uint64_t *previous_table = NULL;
+    uint64_t previous_count = 0;
+    if (loaded_size >= 0 && map_file(bin_path, &previous) && previous.size >= 40 &&
+        memcmp(previous.data, BINARY_SIDECAR_MAGIC, 8) == 0) {
+        const uint64_t *header = (const uint64_t *)(previous.data + 8);
+        if (header[0] == (uint64_t)loaded_size && header[1] == (uint64_t)loaded_mtime_ns &&
+            header[3] + header[2] * 24 <= previous.size) {
+            previous_count = header[2];
+            previous_table = (const uint64_t *)(previous.data + header[3]);
+        }
+    }
+
+    FILE *file = fopen(bin_temp_path, "wb");
+    if (!file) {
+        unmap_file(&previous);
+        return 0;
+    }
+    uint64_t *table = (uint64_t *)malloc(3 * (size_t)(obj->size + 1) * sizeof(uint64_t));
+    if (!table) {
+        fclose(file);
+        unlink(bin_temp_path);
+        unmap_file(&previous);
+        return 0;
+    }
+
+    uint64_t header[4] = {0, 0, 0, 0};
+    fwrite(BINARY_SIDECAR_MAGIC, 1, 8, file);
+    fwrite(header, sizeof(uint64_t), 4, file);
+
+    uint64_t count = 0, reused = 0;
+    uint64_t previous_cursor = 0; // Table position after the last reused record
+    mpz_t dimension;
+    mpz_init(dimension);
+    for (int i = 0; i < obj->size; i++) {
+        JsonEntry *entry = obj->entries[i];
+        unsigned long n;
+        if (!json_key_to_n(entry->key, &n) || !entry->entry->dimension) continue;
+        uint64_t offset = (uint64_t)ftell(file);
+
+        // Unchanged entry: copy its previous record. The table is in entry order, so the search
+        // resumes after the last match and wraps around only when the record is further back.
+        int copied = 0;
+        if (!changed[i] && previous_table) {
+            for (uint64_t step = 0; step < previous_count; step++) {
+                uint64_t k = previous_cursor + step;
+                if (k >= previous_count) k -= previous_count;
+                if (previous_table[3 * k] == n && previous_table[3 * k + 2] >= 16 &&
+                    previous_table[3 * k + 1] + previous_table[3 * k + 2] <= previous.size) {
+                    const char *record = previous.data + previous_table[3 * k + 1];
+                    double c_lambda = json_rounded_c_lambda(entry->entry->c_lambda);
+                    fwrite(record, 1, 8, file);
+                    fwrite(&c_lambda, sizeof(double), 1, file);
+                    fwrite(record + 16, 1, previous_table[3 * k + 2] - 16, file);
+                    previous_cursor = k + 1;
+                    copied = 1;
+                    reused++;
+                    break;
+                }
+            }
+        }
+        if (!copied) {
+            PartitionEntry *pe = entry->entry;
+            if (mpz_set_str(dimension, pe->dimension, 10) != 0) continue;
+            size_t limbs = (mpz_sizeinbase(dimension, 2) + 63) / 64;
+            uint64_t *words = (uint64_t *)calloc(limbs ? limbs : 1, sizeof(uint64_t));
+            if (!words) continue;
+            size_t written = 0;
+            mpz_export(words, &written, -1, sizeof(uint64_t), 0, 0, dimension);
+
+            uint64_t n64 = n;
+            uint32_t counts[2] = {(uint32_t)pe->partition_size, 0};
+            uint64_t num_limbs = written;
+            int32_t pad = 0;
+            double c_lambda = json_rounded_c_lambda(pe->c_lambda);
+            fwrite(&n64, sizeof(n64), 1, file);
+            fwrite(&c_lambda, sizeof(double), 1, file);
+            fwrite(counts, sizeof(uint32_t), 2, file);
+            for (int j = 0; j < pe->partition_size; j++) {
+                int32_t part = pe->partition[j];
+                fwrite(&part, sizeof(part), 1, file);
             }
+            if (pe->partition_size % 2) fwrite(&pad, sizeof(pad), 1, file);
+            fwrite(&num_limbs, sizeof(num_limbs), 1, file);
+            fwrite(words, sizeof(uint64_t), written, file);
+            free(words);
         }
+        table[3 * count] = n;
+        table[3 * count + 1] = offset;
+        table[3 * count + 2] = (uint64_t)ftell(file) - offset;
+        count++;
     }
+    mpz_clear(dimension);
+    unmap_file(&previous);
+
+    // Table, then the header now that sizes are known (it describes the JSON just written)
+    header[3] = (uint64_t)ftell(file);
+    fwrite(table, sizeof(uint64_t), 3 * count, file);
+    free(table);
+    header[0] = (uint64_t)obj->source_size;
+    header[1] = (uint64_t)obj->source_mtime_ns;
+    header[2] = count;
+    fseek(file, 8, SEEK_SET);
+    fwrite(header, sizeof(uint64_t), 4, file);
+
+    if (!commit_temp_file(file, bin_temp_path, bin_path)) return 0;
+    printf("Wrote binary sidecar '%s' (%llu records, %llu reused).\n", bin_path,
+           (unsigned long long)count, (unsigned long long)reused);
+    return 1;
+}
 
-    fclose(file);
-    return obj;
+// Serialize one entry (from its key line to its closing brace, without the separator)
+static void json_write_entry(FILE *file, const JsonEntry *entry) {
+    PartitionEntry *partition_entry = entry->entry;
+
+    fprintf(file, "    \"%s\": {\n", entry->key);
+
+    // Write dimension - ensure we're writing the full, exact dimension string
+    fprintf(file, "        \"dimension\": \"%s\",\n", partition_entry->dimension);
+
+    // Write partition array
+    fprintf(file, "        \"partition\": [");
+    for (int j = 0; j < partition_entry->partition_size; j++) {
+        fprintf(file, "%d", partition_entry->partition[j]);
+        if (j < partition_entry->partition_size - 1) {
+            fprintf(file, ", ");
+        }
+    }
+    fprintf(file, "],\n");
+
+    // Write c_lambda with high precision
+    fprintf(file, "        \"c_lambda\": " C_LAMBDA_JSON_FORMAT "\n", partition_entry->c_lambda);
+
+    fprintf(file, "    }");
 }
 
-// Write a JSON object to file
+// Write a JSON object to file: through a temp file renamed over the target, copying the text of
+// entries unchanged since loading, and with a sidecar index <file>.idx of entry byte ranges
 int json_dump_file(JsonObject *obj, const char *filename) {
     if (!obj || !filename) return 0;
 
-    FILE *file = fopen(filename, "w");
-    if (!file) return 0;
+    // The loaded file, if it is still the one we read; otherwise every entry is serialized
+    MappedFile source = {NULL, 0};
+    if (obj->source_path) {
+        struct stat st;
+        if (stat(obj->source_path, &st) == 0 && (long long)st.st_size == obj->source_size &&
+            stat_mtime_ns(&st) == obj->source_mtime_ns) {
+            map_file(obj->source_path, &source);
+        }
+    }
+
+    char temp_path[4096], index_path[4096], index_temp_path[4096];
+    if (!sidecar_path(temp_path, sizeof(temp_path), filename, ".tmp") ||
+        !sidecar_path(index_path, sizeof(index_path), filename, ".idx") ||
+        !sidecar_path(index_temp_path, sizeof(index_temp_path), filename, ".idx.tmp")) {
+        unmap_file(&source);
+        return 0;
+    }
+
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        unmap_file(&source);
+        return 0;
+    }
+    uint64_t *offsets = (uint64_t *)malloc(2 * (size_t)(obj->size + 1) * sizeof(uint64_t));
+    char *changed = (char *)malloc((size_t)obj->size + 1);
+    if (!offsets || !changed) {
+        free(offsets);
+        free(changed);
+        fclose(file);
+        unlink(temp_path);
+        unmap_file(&source);
+        return 0;
+    }
 
     // Write opening brace
     fprintf(file, "{\n");
 
     // Write entries
+    int copied = 0;
     for (int i = 0; i < obj->size; i++) {
         JsonEntry *entry = obj->entries[i];
-        PartitionEntry *partition_entry = entry->entry;
+        changed[i] = (char)entry->dirty;
+        offsets[2 * i] = (uint64_t)ftell(file);
+        if (!entry->dirty && source.data && entry->src_offset >= 0 &&
+            (size_t)(entry->src_offset + entry->src_length) <= source.size) {
+            fwrite(source.data + entry->src_offset, 1, (size_t)entry->src_length, file);
+            copied++;
+        } else {
+            json_write_entry(file, entry);
+        }
+        offsets[2 * i + 1] = (uint64_t)ftell(file) - offsets[2 * i];
 
-        fprintf(file, "    \"%s\": {\n", entry->key);
+        // Close object
+        fprintf(file, (i < obj->size - 1) ? ",\n" : "\n");
+    }
 
-        // Write dimension - ensure we're writing the full, exact dimension string
-        fprintf(file, "        \"dimension\": \"%s\",\n", partition_entry->dimension);
+    // Write closing brace
+    fprintf(file, "}\n");
+    unmap_file(&source);
 
-        // Write dimension to JSON
+    if (!commit_temp_file(file, temp_path, filename)) {
+        free(offsets);
+        free(changed);
+        return 0;
+    }
+    printf("Wrote %d entries (%d unchanged entries copied from the previous file).\n", obj->size, copied);
+
+    // The new file is the source of the next dump; entries now match their ranges in it
+    long long loaded_size = obj->source_size, loaded_mtime_ns = obj->source_mtime_ns;
+    struct stat st;
+    if (stat(filename, &st) == 0) {
+        free(obj->source_path);
+        obj->source_path = strdup(filename);
+        obj->source_size = (long long)st.st_size;
+        obj->source_mtime_ns = stat_mtime_ns(&st);
+        for (int i = 0; i < obj->size; i++) {
+            obj->entries[i]->dirty = 0;
+            obj->entries[i]->src_offset = (long)offsets[2 * i];
+            obj->entries[i]->src_length = (long)offsets[2 * i + 1];
+        }
+    }
 
-        // Write partition array
-        fprintf(file, "        \"partition\": [");
-        for (int j = 0; j < partition_entry->partition_size; j++) {
-            fprintf(file, "%d", partition_entry->partition[j]);
-            if (j < partition_entry->partition_size - 1) {
-                fprintf(file, ", ");
-            }
+    // Sidecar index: magic, JSON size, JSON mtime (ns), entry count, then per entry its size n
+    // (UINT64_MAX for other keys), byte offset and length
+    FILE *index = fopen(index_temp_path, "wb");
+    if (index) {
+        uint64_t header[3] = {(uint64_t)obj->source_size, (uint64_t)obj->source_mtime_ns, (uint64_t)obj->size};
+        fwrite(JSON_INDEX_MAGIC, 1, 8, index);
+        fwrite(header, sizeof(uint64_t), 3, index);
+        for (int i = 0; i < obj->size; i++) {
+            unsigned long n;
+            uint64_t record[3] = {json_key_to_n(obj->entries[i]->key, &n) ? (uint64_t)n : UINT64_MAX,
+                                  offsets[2 * i], offsets[2 * i + 1]};
+            fwrite(record, sizeof(uint64_t), 3, index);
+        }
+        if (!commit_temp_file(index, index_temp_path, index_path)) {
+            fprintf(stderr, "Warning: Failed to write index '%s'.\n", index_path);
         }
-        fprintf(file, "],\n");
+    }
+    free(offsets);
+
+    if (write_binary_sidecar && !binary_sidecar_write(obj, filename, changed, loaded_size, loaded_mtime_ns)) {
+        fprintf(stderr, "Warning: Failed to write binary sidecar for '%s'.\n", filename);
+    }
+    free(changed);
+    return 1;
+}
 
-        // Write c_lambda with high precision
-        fprintf(file, "        \"c_lambda\": %.16f\n", partition_entry->c_lambda);
+// Check whether the line [line, line + len) starts with prefix
+static int line_has_prefix(const char *line, size_t len, const char *prefix) {
+    size_t prefix_len = strlen(prefix);
+    return len >= prefix_len && memcmp(line, prefix, prefix_len) == 0;
+}
 
-        // Close object
-        if (i < obj->size - 1) {
-            fprintf(file, "    },\n");
+/**
+ * Parse the first "[a, b, ...]" in [start, end) into an array, without copying the text
+ */
+int *parse_partition_range(const char *start, const char *end, int *partition_size) {
+    const char *open = memchr(start, '[', end - start);
+    if (!open) {
+        fprintf(stderr, "Error: Invalid partition string format (missing '[').\n");
+        return NULL;
+    }
+    const char *close = memchr(open, ']', end - open);
+    if (!close) {
+        fprintf(stderr, "Error: Invalid partition string format (missing ']').\n");
+        return NULL;
+    }
+
+    // Count the number of commas to determine array size
+    int count = 1;
+    for (const char *p = open + 1; p < close; p++) {
+        if (*p == ',') count++;
+    }
+
+    int *partition = (int *)malloc(count * sizeof(int));
+    if (!partition) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return NULL;
+    }
+
+    // Parse each comma-separated value (same result as atoi on each token)
+    int i = 0;
+    const char *p = open + 1;
+    while (p < close && i < count) {
+        while (p < close && *p == ' ') p++;
+        int sign = 1, value = 0;
+        if (p < close && (*p == '-' || *p == '+')) {
+            if (*p == '-') sign = -1;
+            p++;
+        }
+        while (p < close && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+        partition[i++] = sign * value;
+        const char *comma = memchr(p, ',', close - p);
+        if (!comma) break;
+        p = comma + 1;
+    }
+
+    *partition_size = i;
+    return partition;
+}
+
+/**
+ * Digits of a non-negative decimal string without leading zeros ("0" stays "0"),
+ * or NULL if it is not a plain digit string (then mpz_set_str decides)
+ */
+const char *normalized_decimal(const char *str) {
+    if (!*str) return NULL;
+    for (const char *p = str; *p; p++) {
+        if (*p < '0' || *p > '9') return NULL;
+    }
+    while (str[0] == '0' && str[1]) str++;
+    return str;
+}
+
+/**
+ * Compare two normalized decimal strings: by length, then memcmp
+ */
+int compare_normalized_decimal(const char *a, const char *b) {
+    size_t a_len = strlen(a), b_len = strlen(b);
+    if (a_len != b_len) return (a_len < b_len) ? -1 : 1;
+    int cmp = memcmp(a, b, a_len);
+    return (cmp > 0) - (cmp < 0);
+}
+
+// One "--- Size n ---" block of the input, prepared (possibly on a worker thread) and
+// then committed to the JSON store in input order
+typedef struct {
+    unsigned long int n;
+    char *f_lambda_str;        // NUL-terminated digits inside the input mapping
+    int *partition;
+    int partition_size;
+
+    int valid;                 // f_lambda is a number
+    int parsed;                // f_lambda converted (only done when the text compare cannot decide)
+    mpz_t f_lambda;
+    int needs_update;          // Larger than (or no) entry at preparation time
+    int stored;                // Committed to the JSON store
+    int had_existing;
+    double c_lambda;           // Set when needs_update, or given by the record stream
+    int has_c_lambda;          // c_lambda came with the block (nothing to convert or compute)
+    char *dimension_str;
+} UpdateBlock;
+
+/**
+ * Parse the dimension, compare it with the stored entry and compute c(lambda) if it will
+ * be stored. Reads the JSON store only, so blocks can be prepared concurrently.
+ */
+void prepare_block(JsonObject *root, UpdateBlock *block) {
+    mpz_t existing_f_lambda;
+
+    mpz_init(block->f_lambda);
+    block->valid = 0;
+    block->parsed = 0;
+    block->stored = 0;
+    block->needs_update = 0;
+    block->had_existing = 0;
+    block->dimension_str = NULL;
+
+    // Create key for JSON object
+    char n_str[32];
+    snprintf(n_str, sizeof(n_str), "%lu", block->n);
+    PartitionEntry *existing_entry = json_object_get(root, n_str);
+
+    // Fast path: plain digit strings are compared as text, and nothing is converted unless it grows
+    const char *digits = normalized_decimal(block->f_lambda_str);
+    if (digits && existing_entry && existing_entry->dimension) {
+        const char *existing_digits = normalized_decimal(existing_entry->dimension);
+        if (existing_digits && compare_normalized_decimal(digits, existing_digits) <= 0) {
+            block->valid = 1;
+            block->had_existing = 1;
+            return;
+        }
+    }
+
+    // c(lambda) given with plain digits: the block is larger than (or has no) entry, and is stored as text
+    if (block->has_c_lambda && digits &&
+        (!existing_entry || !existing_entry->dimension || normalized_decimal(existing_entry->dimension))) {
+        block->valid = 1;
+        block->had_existing = existing_entry && existing_entry->dimension;
+        block->dimension_str = strdup(digits);
+        block->needs_update = block->dimension_str != NULL;
+        if (!block->dimension_str) fprintf(stderr, "Error: Failed to convert dimension to string.\n");
+        return;
+    }
+
+    // Convert f_lambda string to mpz_t
+    if (mpz_set_str(block->f_lambda, block->f_lambda_str, 10) != 0) {
+        fprintf(stderr, "Error: Invalid f^lambda value '%s'.\n", block->f_lambda_str);
+        return;
+    }
+    block->valid = 1;
+    block->parsed = 1;
+
+    // Check if we need to update
+    block->needs_update = 1;
+
+    if (existing_entry && existing_entry->dimension) {
+        block->had_existing = 1;
+        // Convert existing dimension to mpz_t
+        mpz_init(existing_f_lambda);
+        if (mpz_set_str(existing_f_lambda, existing_entry->dimension, 10) == 0) {
+            // Compare dimensions
+            if (mpz_cmp(block->f_lambda, existing_f_lambda) <= 0) {
+                block->needs_update = 0;
+            }
         } else {
-            fprintf(file, "    }\n");
+            fprintf(stderr, "Error: Failed to parse existing dimension '%s', will update anyway.\n",
+                    existing_entry->dimension);
         }
+        mpz_clear(existing_f_lambda);
     }
 
-    // Write closing brace
-    fprintf(file, "}\n");
+    if (block->needs_update && !block->has_c_lambda) {
+        // Calculate c_lambda
+        mpf_t c_lambda_val;
+        mpf_init(c_lambda_val);
+        compute_c_lambda_selected(c_lambda_val, block->f_lambda, block->n);
+        block->c_lambda = mpf_get_d(c_lambda_val);
+        mpf_clear(c_lambda_val);
+    }
+
+    if (block->needs_update) {
+        // Set dimension - ensure the full value is captured without truncation (normalized digits
+        // are exactly what mpz_get_str would print)
+        block->dimension_str = digits ? strdup(digits) : mpz_get_str(NULL, 10, block->f_lambda);
+        if (!block->dimension_str) {
+            fprintf(stderr, "Error: Failed to convert dimension to string.\n");
+            block->needs_update = 0;
+        }
+    }
+}
+
+/**
+ * Compare the dimensions of two prepared blocks (as text when both are plain digit strings)
+ */
+int compare_block_values(UpdateBlock *a, UpdateBlock *b) {
+    const char *a_digits = normalized_decimal(a->f_lambda_str);
+    const char *b_digits = normalized_decimal(b->f_lambda_str);
+    if (a_digits && b_digits) return compare_normalized_decimal(a_digits, b_digits);
+    // A block that is not plain digits was converted, and a stored block always is
+    if (!a->parsed) { mpz_set_str(a->f_lambda, a->f_lambda_str, 10); a->parsed = 1; }
+    if (!b->parsed) { mpz_set_str(b->f_lambda, b->f_lambda_str, 10); b->parsed = 1; }
+    return mpz_cmp(a->f_lambda, b->f_lambda);
+}
+
+/**
+ * Store a prepared block. earlier_update is the most recent block of this batch that stored
+ * the same n (its value replaced the one the block was compared with), or NULL.
+ */
+void commit_block(JsonObject *root, UpdateBlock *block, UpdateBlock *earlier_update) {
+    if (!block->valid) return;
+
+    int needs_update = block->needs_update;
+    int had_existing = block->had_existing;
+    if (earlier_update) {
+        // Only possible when the block was prepared against the entry this batch replaced
+        needs_update = compare_block_values(block, earlier_update) > 0 && block->dimension_str;
+        had_existing = 1;
+    }
+
+    if (had_existing) {
+        if (!needs_update) {
+            printf("Skipping n=%lu: keeping existing dimension\n", block->n);
+            return;
+        }
+        printf("Found larger dimension for n=%lu\n", block->n);
+    } else {
+        printf("Adding new entry for n=%lu\n", block->n);
+    }
+    if (!needs_update) return;
+
+    // Create new entry
+    PartitionEntry *new_entry = (PartitionEntry *)malloc(sizeof(PartitionEntry));
+    if (!new_entry) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return;
+    }
+    new_entry->dimension = block->dimension_str;
+    block->dimension_str = NULL; // Owned by the entry now
+
+    // Copy partition array
+    new_entry->partition = (int *)malloc(block->partition_size * sizeof(int));
+    if (new_entry->partition) {
+        memcpy(new_entry->partition, block->partition, block->partition_size * sizeof(int));
+        new_entry->partition_size = block->partition_size;
+    } else {
+        new_entry->partition_size = 0;
+    }
+
+    // Set c_lambda, rounded as it is written
+    new_entry->c_lambda = json_rounded_c_lambda(block->c_lambda);
+
+    // Update JSON object
+    char n_str[32];
+    snprintf(n_str, sizeof(n_str), "%lu", block->n);
+    json_object_set(root, n_str, new_entry);
+    block->stored = 1;
+
+    printf("Updated n=%lu: new dimension saved\n", block->n);
+}
+
+void update_block_clear(UpdateBlock *block) {
+    mpz_clear(block->f_lambda);
+    free(block->dimension_str);
+    free(block->partition);
+    block->dimension_str = NULL;
+    block->partition = NULL;
+}
+
+// Blocks of one batch shared by the worker threads
+typedef struct {
+    JsonObject *root;
+    UpdateBlock *blocks;
+    int num_blocks;
+    int next_block;            // Claimed with an atomic fetch-add
+} BatchWork;
+
+void *prepare_worker(void *arg) {
+    BatchWork *work = (BatchWork *)arg;
+    int i;
+    while ((i = __atomic_fetch_add(&work->next_block, 1, __ATOMIC_RELAXED)) < work->num_blocks) {
+        prepare_block(work->root, &work->blocks[i]);
+    }
+    mpfr_free_cache(); // This thread's MPFR constant caches
+    return NULL;
+}
+
+/**
+ * Prepare a batch of blocks on num_threads threads, then commit them in input order
+ */
+void process_batch(JsonObject *root, UpdateBlock *blocks, int num_blocks, int num_threads) {
+    BatchWork work = {root, blocks, num_blocks, 0};
+    if (num_threads > 1 && num_blocks > 1) {
+        pthread_t threads[MAX_THREADS];
+        int started = 0;
+        for (int t = 0; t < num_threads && t < num_blocks; t++) {
+            if (pthread_create(&threads[started], NULL, prepare_worker, &work) == 0) started++;
+        }
+        prepare_worker(&work); // The main thread helps (and finishes the batch if no thread started)
+        for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    } else {
+        prepare_worker(&work);
+    }
+
+    for (int i = 0; i < num_blocks; i++) {
+        // A size repeated within the batch compares against its latest stored value
+        UpdateBlock *earlier_update = NULL;
+        for (int j = i - 1; j >= 0 && !earlier_update; j--) {
+            if (blocks[j].n == blocks[i].n && blocks[j].stored) {
+                earlier_update = &blocks[j];
+            }
+        }
+        commit_block(root, &blocks[i], earlier_update);
+    }
+    for (int i = 0; i < num_blocks; i++) update_block_clear(&blocks[i]);
+}
+
+// Record of the heuristic's --c-lambda-stream file (layout in heuristic_dim_lambda.cpp)
+typedef struct {
+    uint64_t n;
+    double c_lambda;
+    uint64_t digits_offset;    // f^lambda digits in the results text (length 0: not there)
+    uint64_t digits_length;
+    uint32_t partition_size;
+    const char *parts;         // partition_size int32 values
+} CLambdaRecord;
+
+/**
+ * Decode the record at *pos and advance past it; 0 at the end or at a truncated record
+ */
+int next_c_lambda_record(const MappedFile *stream, size_t *pos, CLambdaRecord *record) {
+    if (*pos + 40 > stream->size) return 0;
+    const char *p = stream->data + *pos;
+    uint32_t counts[2];
+    memcpy(&record->n, p, 8);
+    memcpy(&record->c_lambda, p + 8, 8);
+    memcpy(&record->digits_offset, p + 16, 8);
+    memcpy(&record->digits_length, p + 24, 8);
+    memcpy(counts, p + 32, 8);
+    size_t parts_bytes = 4 * ((size_t)counts[0] + counts[0] % 2);
+    if (counts[0] > MAX_PARTITION_SIZE || *pos + 40 + parts_bytes > stream->size) return 0;
+    record->partition_size = counts[0];
+    record->parts = p + 40;
+    *pos += 40 + parts_bytes;
+    return 1;
+}
+
+/**
+ * Check that the digits at [begin, begin + length) are the "Max f^lambda: " value of the size n block
+ * of the results text: the line above is "--- Size n ---" and the line below lists partition first.
+ * A record of an earlier results file (or of a size since recomputed) fails one of the two.
+ */
+int record_matches_text(const MappedFile *txt_map, uint64_t begin, uint64_t length, unsigned long n,
+                        const int *partition, int partition_size) {
+    static const size_t prefix_len = 14; // "Max f^lambda: "
+    const char *data = txt_map->data;
+    const char *line = data + begin - prefix_len;
+    if (line == data || line[-1] != '\n') return 0;
+
+    // Line above, without its '\n' (and '\r')
+    const char *above_end = line - 1;
+    const char *above = above_end;
+    while (above > data && above[-1] != '\n') above--;
+    if (above_end > above && above_end[-1] == '\r') above_end--;
+    char marker[48];
+    int marker_len = snprintf(marker, sizeof(marker), "--- Size %lu ---", n);
+    if (above_end - above != marker_len || memcmp(above, marker, marker_len) != 0) return 0;
+
+    // Line below: its first partition
+    const char *data_end = data + txt_map->size;
+    const char *below = memchr(data + begin + length, '\n', data_end - (data + begin + length));
+    if (!below) return 0;
+    below++;
+    const char *below_end = memchr(below, '\n', data_end - below);
+    if (!below_end) below_end = data_end;
+    if (!line_has_prefix(below, below_end - below, "Partitions achieving maximum: ")) return 0;
+    int listed_size = 0;
+    int *listed = parse_partition_range(below + 30, below_end, &listed_size);
+    int same = listed && listed_size == partition_size &&
+               memcmp(listed, partition, partition_size * sizeof(int)) == 0;
+    free(listed);
+    return same;
+}
 
-    fclose(file);
+/**
+ * Queue the records of a c(lambda) stream as blocks: n, c(lambda) and the partition come from
+ * the record, the dimension digits are taken in place from the results text. A record whose
+ * reference does not point at the "Max f^lambda: " value of its size, followed by its partition
+ * as the first maximizer, is skipped. The recorded
+ * c(lambda) is only taken in the fast mode; the exact and verify modes compute it again.
+ */
+int process_c_lambda_stream(JsonObject *root, const char *stream_file, MappedFile *txt_map,
+                            UpdateBlock *batch, int batch_capacity, int num_threads) {
+    MappedFile stream;
+    if (!map_file(stream_file, &stream)) {
+        fprintf(stderr, "Error: Could not open c(lambda) stream '%s'.\n", stream_file);
+        return 0;
+    }
+    if (stream.size < 8 || memcmp(stream.data, C_LAMBDA_STREAM_MAGIC, 8) != 0) {
+        fprintf(stderr, "Error: '%s' is not a c(lambda) stream.\n", stream_file);
+        unmap_file(&stream);
+        return 0;
+    }
+
+    static const char value_prefix[] = "Max f^lambda: ";
+    const size_t prefix_len = sizeof(value_prefix) - 1;
+    int batch_size = 0;
+    size_t pos = 8;
+    CLambdaRecord record;
+    while (next_c_lambda_record(&stream, &pos, &record)) {
+        printf("Processing n=%lu...\n", (unsigned long)record.n);
+
+        uint64_t begin = record.digits_offset, length = record.digits_length;
+        int referenced = length > 0 && begin >= prefix_len && begin + length < txt_map->size &&
+                         memcmp(txt_map->data + begin - prefix_len, value_prefix, prefix_len) == 0 &&
+                         (txt_map->data[begin + length] == ' ' || txt_map->data[begin + length] == '\n');
+        if (!referenced) {
+            fprintf(stderr, "Warning: Skipping n=%lu: its digits are not at the recorded position of the results text.\n",
+                    (unsigned long)record.n);
+            continue;
+        }
+
+        int *partition = (int *)malloc((record.partition_size ? record.partition_size : 1) * sizeof(int));
+        if (!partition) {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            continue;
+        }
+        for (uint32_t j = 0; j < record.partition_size; j++) {
+            int32_t part;
+            memcpy(&part, record.parts + 4 * j, 4);
+            partition[j] = part;
+        }
+        if (!record_matches_text(txt_map, begin, length, (unsigned long)record.n, partition,
+                                 (int)record.partition_size)) {
+            fprintf(stderr, "Warning: Skipping n=%lu: the recorded position is not its block of the results text.\n",
+                    (unsigned long)record.n);
+            free(partition);
+            continue;
+        }
+
+        // Terminate the digits in place (the mapping is private and the text is not scanned)
+        UpdateBlock *block = &batch[batch_size];
+        txt_map->data[begin + length] = '\0';
+        block->n = (unsigned long)record.n;
+        block->f_lambda_str = txt_map->data + begin;
+        block->partition = partition;
+        block->partition_size = (int)record.partition_size;
+        block->c_lambda = record.c_lambda;
+        block->has_c_lambda = c_lambda_mode == C_LAMBDA_FAST; // Other modes recompute it
+        batch_size++;
+
+        if (batch_size == batch_capacity) {
+            process_batch(root, batch, batch_size, num_threads);
+            batch_size = 0;
+        }
+    }
+    if (batch_size > 0) {
+        process_batch(root, batch, batch_size, num_threads);
+    }
+    if (pos != stream.size) {
+        fprintf(stderr, "Warning: Ignoring a truncated record at the end of '%s'.\n", stream_file);
+    }
+    unmap_file(&stream);
     return 1;
 }
 
+// Shape diagnostics of every entry, one array per column (written as a columnar file)
+typedef struct {
+    int num_rows;
+    uint64_t *n;
+    double *c_lambda;
+    uint32_t *distinct_parts;   // Runs of equal parts (the diagram has distinct_parts removable corners)
+    double *first_row;          // lambda_1 / sqrt(n)
+    double *length;             // l(lambda) / sqrt(n)
+    double *sup_distance;       // sup_u |psi_lambda(u) - Omega(u)|
+    double *sup_u;              // Where it is attained
+    double *moment[4];          // m_k, k = 1..4, of (psi_lambda(u) - |u|) / 2
+} ShapeAnalytics;
+
+#define ANALYTICS_MAGIC "DIMLANA1"
+#define ANALYTICS_COLUMNS 12
+#define ANALYTICS_BLOCK 256         /* Entries claimed by a worker at a time */
+
+// Vershik-Kerov / Logan-Shepp limit shape
+static inline double limit_shape_omega(double u) {
+    double a = fabs(u);
+    if (a >= 2.0) return a;
+    return (2.0 / M_PI) * (u * asin(0.5 * u) + sqrt(4.0 - u * u));
+}
+
+/**
+ * Diagnostics of one partition in Russian coordinates scaled by 1/sqrt(n). The profile psi is
+ * piecewise linear between the corners of the diagram, which alternate minima x_0 < y_1 < x_1
+ * < ... < y_m < x_m (addable corners x, removable corners y; one pair per run of equal parts).
+ * psi has slope +-1 between corners and |Omega'| <= 1, so psi - Omega is monotone on each segment
+ * (and outside [x_0, x_m]); its extremes are at corners and the sup distance is exact there.
+ * (psi - |u|)'' / 2 = sum delta_x - sum delta_y - delta_0, hence the moments of (psi - |u|) / 2
+ * are m_k = (sum x^(k+2) - sum y^(k+2)) / ((k+1)(k+2)); the limit shape has m_2 = 1/2,
+ * m_4 = 2/3 and vanishing odd moments.
+ */
+static void shape_analytics_entry(ShapeAnalytics *a, int row, unsigned long n, const PartitionEntry *entry,
+                                  double *u, double *v) {
+    const int *parts = entry->partition;
+    int len = entry->partition_size;
+    double scale = 1.0 / sqrt((double)n);
+
+    // Corners from the runs: addable (lambda_i, i-1) where a run starts, removable (lambda_i, i) where it ends
+    int corners = 0, runs = 0;
+    for (int i = 0; i < len; ) {
+        int j = i;
+        while (j + 1 < len && parts[j + 1] == parts[i]) j++;
+        u[corners] = (parts[i] - i) * scale;
+        v[corners++] = (parts[i] + i) * scale;
+        u[corners] = (parts[i] - (j + 1)) * scale;
+        v[corners++] = (parts[i] + (j + 1)) * scale;
+        runs++;
+        i = j + 1;
+    }
+    u[corners] = -len * scale; // Addable corner below the last row
+    v[corners++] = len * scale;
+
+    // Distance to the limit shape at the corners (the profile values are v)
+    double sup = 0.0, sup_at = 0.0;
+    for (int k = 0; k < corners; k++) {
+        double d = fabs(v[k] - limit_shape_omega(u[k]));
+        if (d > sup) {
+            sup = d;
+            sup_at = u[k];
+        }
+    }
+
+    // Moments from the alternating power sums
+    double power_sum[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int k = 0; k < corners; k++) {
+        double sign = (k % 2) ? -1.0 : 1.0;
+        double p = u[k] * u[k] * u[k]; // u^(k+2) for moment 1
+        for (int m = 0; m < 4; m++) {
+            power_sum[m] += sign * p;
+            p *= u[k];
+        }
+    }
+
+    a->n[row] = n;
+    a->c_lambda[row] = entry->c_lambda;
+    a->distinct_parts[row] = (uint32_t)runs;
+    a->first_row[row] = len ? parts[0] * scale : 0.0;
+    a->length[row] = len * scale;
+    a->sup_distance[row] = sup;
+    a->sup_u[row] = sup_at;
+    for (int m = 0; m < 4; m++) {
+        a->moment[m][row] = power_sum[m] / ((m + 2) * (m + 3));
+    }
+}
+
+typedef struct {
+    JsonObject *root;
+    ShapeAnalytics *analytics;
+    int *entry_of_row;          // Store position of each row
+    int next_row;               // Claimed in blocks with an atomic fetch-add
+    int failed;                 // Set when a row could not be computed
+} AnalyticsWork;
+
+// Row whose diagnostics could not be computed
+static void shape_analytics_missing(ShapeAnalytics *a, int row, unsigned long n) {
+    a->n[row] = n;
+    a->c_lambda[row] = NAN;
+    a->distinct_parts[row] = 0;
+    a->first_row[row] = NAN;
+    a->length[row] = NAN;
+    a->sup_distance[row] = NAN;
+    a->sup_u[row] = NAN;
+    for (int m = 0; m < 4; m++) {
+        a->moment[m][row] = NAN;
+    }
+}
+
+void *analytics_worker(void *arg) {
+    AnalyticsWork *work = (AnalyticsWork *)arg;
+    int capacity = 0;
+    double *u = NULL, *v = NULL;
+    int begin;
+    while ((begin = __atomic_fetch_add(&work->next_row, ANALYTICS_BLOCK, __ATOMIC_RELAXED)) < work->analytics->num_rows) {
+        int end = begin + ANALYTICS_BLOCK;
+        if (end > work->analytics->num_rows) end = work->analytics->num_rows;
+        for (int row = begin; row < end; row++) {
+            JsonEntry *entry = work->root->entries[work->entry_of_row[row]];
+            unsigned long n = strtoul(entry->key, NULL, 10);
+            int needed = 2 * entry->entry->partition_size + 1;
+            if (needed > capacity) {
+                free(u);
+                free(v);
+                capacity = needed;
+                u = (double *)malloc(capacity * sizeof(double));
+                v = (double *)malloc(capacity * sizeof(double));
+                if (!u || !v) {
+                    fprintf(stderr, "Error: Memory allocation failed.\n");
+                    capacity = 0;
+                    shape_analytics_missing(work->analytics, row, n);
+                    __atomic_store_n(&work->failed, 1, __ATOMIC_RELAXED);
+                    continue;
+                }
+            }
+            shape_analytics_entry(work->analytics, row, n, entry->entry, u, v);
+        }
+    }
+    free(u);
+    free(v);
+    return NULL;
+}
+
+/**
+ * Compute the shape diagnostics of all entries with a numeric key and a partition of that size,
+ * on num_threads threads, and write them as a columnar file:
+ *   magic "DIMLANA1", uint64 row count, uint32 column count, uint32 0,
+ *   per column: char name[16], uint32 element size, uint32 0, uint64 data offset;
+ *   then each column's array (rows in store order)
+ */
+int write_shape_analytics(JsonObject *root, const char *filename, int num_threads) {
+    int *entry_of_row = (int *)malloc((root->size + 1) * sizeof(int));
+    if (!entry_of_row) return 0;
+    int num_rows = 0;
+    for (int i = 0; i < root->size; i++) {
+        PartitionEntry *entry = root->entries[i]->entry;
+        unsigned long n;
+        if (!json_key_to_n(root->entries[i]->key, &n) || n == 0 || !entry->partition) continue;
+        unsigned long total = 0;
+        for (int j = 0; j < entry->partition_size; j++) total += (unsigned long)entry->partition[j];
+        if (total == n) entry_of_row[num_rows++] = i;
+    }
+
+    ShapeAnalytics a;
+    a.num_rows = num_rows;
+    size_t rows = (size_t)num_rows + 1;
+    a.n = (uint64_t *)malloc(rows * sizeof(uint64_t));
+    a.distinct_parts = (uint32_t *)malloc(rows * sizeof(uint32_t));
+    double *doubles = (double *)malloc(rows * 9 * sizeof(double));
+    if (!a.n || !a.distinct_parts || !doubles) {
+        free(a.n);
+        free(a.distinct_parts);
+        free(doubles);
+        free(entry_of_row);
+        return 0;
+    }
+    a.c_lambda = doubles;
+    a.first_row = doubles + rows;
+    a.length = doubles + 2 * rows;
+    a.sup_distance = doubles + 3 * rows;
+    a.sup_u = doubles + 4 * rows;
+    for (int m = 0; m < 4; m++) a.moment[m] = doubles + (5 + m) * rows;
+
+    AnalyticsWork work = {root, &a, entry_of_row, 0, 0};
+    pthread_t threads[MAX_THREADS];
+    int started = 0;
+    for (int t = 1; t < num_threads && t * ANALYTICS_BLOCK < num_rows; t++) {
+        if (pthread_create(&threads[started], NULL, analytics_worker, &work) == 0) started++;
+    }
+    analytics_worker(&work);
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    if (work.failed) {
+        // Rows are incomplete (filled with NaN): keep the previous file
+        free(a.n);
+        free(a.distinct_parts);
+        free(doubles);
+        free(entry_of_row);
+        return 0;
+    }
+
+    struct {
+        const char *name;
+        const void *data;
+        uint32_t element_size;
+    } columns[ANALYTICS_COLUMNS] = {
+        {"n", a.n, 8}, {"c_lambda", a.c_lambda, 8}, {"distinct_parts", a.distinct_parts, 4},
+        {"first_row", a.first_row, 8}, {"length", a.length, 8}, {"sup_distance", a.sup_distance, 8},
+        {"sup_u", a.sup_u, 8}, {"moment1", a.moment[0], 8}, {"moment2", a.moment[1], 8},
+        {"moment3", a.moment[2], 8}, {"moment4", a.moment[3], 8}, {NULL, NULL, 0},
+    };
+    int num_columns = 0;
+    while (num_columns < ANALYTICS_COLUMNS && columns[num_columns].name) num_columns++;
+
+    char temp_path[4096];
+    int ok = sidecar_path(temp_path, sizeof(temp_path), filename, ".tmp");
+    FILE *file = ok ? fopen(temp_path, "wb") : NULL;
+    if (file) {
+        uint64_t count = (uint64_t)num_rows;
+        uint32_t counts[2] = {(uint32_t)num_columns, 0};
+        fwrite(ANALYTICS_MAGIC, 1, 8, file);
+        fwrite(&count, sizeof(count), 1, file);
+        fwrite(counts, sizeof(uint32_t), 2, file);
+        uint64_t offset = 24 + (uint64_t)num_columns * 32;
+        for (int c = 0; c < num_columns; c++) {
+            char name[16] = {0};
+            strncpy(name, columns[c].name, sizeof(name) - 1);
+            uint32_t sizes[2] = {columns[c].element_size, 0};
+            fwrite(name, 1, sizeof(name), file);
+            fwrite(sizes, sizeof(uint32_t), 2, file);
+            fwrite(&offset, sizeof(offset), 1, file);
+            offset += (uint64_t)columns[c].element_size * num_rows;
+            offset = (offset + 7) & ~(uint64_t)7;
+        }
+        for (int c = 0; c < num_columns; c++) {
+            fwrite(columns[c].data, columns[c].element_size, (size_t)num_rows, file);
+            size_t pad = (size_t)(-(long)(columns[c].element_size * (size_t)num_rows) & 7);
+            uint64_t zero = 0;
+            fwrite(&zero, 1, pad, file);
+        }
+        ok = commit_temp_file(file, temp_path, filename);
+    } else {
+        ok = 0;
+    }
+    if (ok) {
+        printf("Wrote shape analytics of %d sizes to '%s'.\n", num_rows, filename);
+    }
+
+    free(a.n);
+    free(a.distinct_parts);
+    free(doubles);
+    free(entry_of_row);
+    return ok;
+}
+
 void print_usage(const char *program_name) {
-    fprintf(stderr, "Usage: %s <input_txt_file> <json_file>\n", program_name);
+    fprintf(stderr, "Usage: %s [--exact-c-lambda | --verify-c-lambda] [--threads=T] [--binary-sidecar]\n"
+                    "       [--c-lambda-stream=records.bin] [--analytics=shape.bin] <input_txt_file> <json_file>\n", program_name);
+    fprintf(stderr, "  --exact-c-lambda: compute c(lambda) through the exact n! (slow at large n)\n");
+    fprintf(stderr, "  --verify-c-lambda: compute both ways, store the exact value and report differences\n");
+    fprintf(stderr, "  --threads=T: parse and compute sizes on T threads, storing them in input order (default 1)\n");
+    fprintf(stderr, "  --c-lambda-stream=PATH: take n, c(lambda) and the partition from the heuristic's record stream\n");
+    fprintf(stderr, "      and the dimension digits from <input_txt_file> at the recorded positions (no parsing);\n");
+    fprintf(stderr, "      with --exact-c-lambda or --verify-c-lambda, c(lambda) is recomputed in that mode\n");
+    fprintf(stderr, "  --analytics=PATH: write limit-shape diagnostics of every stored size to PATH (columnar)\n");
+    fprintf(stderr, "  --binary-sidecar: also write <json_file>.bin with partitions, c(lambda) and dimensions as limbs\n");
     fprintf(stderr, "  <input_txt_file>: path to text file with partition data\n");
     fprintf(stderr, "  <json_file>: path to JSON file to update\n");
 }
@@ -442,19 +1720,46 @@ int main(int argc, char *argv[]) {
     mpf_set_default_prec(DEFAULT_GMP_PRECISION);
 
     // Parse command line arguments
-    if (argc != 3) {
+    const char *positional[2];
+    int num_positional = 0;
+    int num_threads = 1;
+    const char *stream_file = NULL;
+    const char *analytics_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--exact-c-lambda") == 0) {
+            c_lambda_mode = C_LAMBDA_EXACT;
+        } else if (strcmp(argv[i], "--verify-c-lambda") == 0) {
+            c_lambda_mode = C_LAMBDA_VERIFY;
+        } else if (strcmp(argv[i], "--binary-sidecar") == 0) {
+            write_binary_sidecar = 1;
+        } else if (strncmp(argv[i], "--c-lambda-stream=", 18) == 0) {
+            stream_file = argv[i] + 18;
+        } else if (strncmp(argv[i], "--analytics=", 12) == 0) {
+            analytics_file = argv[i] + 12;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            num_threads = atoi(argv[i] + 10);
+            if (num_threads < 1) num_threads = 1;
+            if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+        } else if (num_positional < 2 && argv[i][0] != '-') {
+            positional[num_positional++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (num_positional != 2) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
     // Define filenames from command line arguments
-    const char *input_txt_file = argv[1];
-    const char *input_json_file = argv[2];
-    const char *output_json_file = argv[2]; // Update the same file
+    const char *input_txt_file = positional[0];
+    const char *input_json_file = positional[1];
+    const char *output_json_file = positional[1]; // Update the same file
 
-    // Open input text file
-    FILE *txt_file = fopen(input_txt_file, "r");
-    if (!txt_file) {
+    // Map the input text file; it is scanned in place with no line length limit
+    MappedFile txt_map;
+    if (!map_file(input_txt_file, &txt_map)) {
         fprintf(stderr, "Error: Could not open input text file '%s'.\n", input_txt_file);
         return EXIT_FAILURE;
     }
@@ -463,192 +1768,124 @@ int main(int argc, char *argv[]) {
     JsonObject *root = json_load_file(input_json_file);
     if (!root) {
         fprintf(stderr, "Error: Failed to create or load JSON object.\n");
-        fclose(txt_file);
+        unmap_file(&txt_map);
         return EXIT_FAILURE;
     }
 
-    // Process the text file
-    char line[MAX_LINE_LENGTH];
+    // Process the text file (or the record stream) in batches of blocks
     unsigned long int current_n = 0;
     int parsing_block = 0;
-    mpz_t current_f_lambda, existing_f_lambda;
-    char f_lambda_str[MAX_LINE_LENGTH] = {0};
-    int *partition = NULL;
-    int partition_size = 0;
-
-    // Read the file line by line
-    while (fgets(line, MAX_LINE_LENGTH, txt_file)) {
-        // Check for size marker
-        if (strstr(line, "--- Size ")) {
-            // Extract n value
-            sscanf(line, "--- Size %lu ---", &current_n);
-            parsing_block = 1;
-
-            // Report progress
-            printf("Processing n=%lu...\n", current_n);
-
-            // Clear previous block data
-            memset(f_lambda_str, 0, sizeof(f_lambda_str));
-            if (partition) {
-                free(partition);
-                partition = NULL;
-            }
-            partition_size = 0;
-        }
-
-        // Extract Max f^lambda
-        if (parsing_block && strstr(line, "Max f^lambda: ")) {
-            // Extract just the digits
-            char *start = strstr(line, "Max f^lambda: ") + 14;
-            char *end = strchr(start, ' ');
+    char *f_lambda_start = NULL; // Digits of Max f^lambda inside the mapping
+    size_t f_lambda_len = 0;
 
-            if (end) {
-                size_t len = end - start;
-                // Ensure we don't exceed buffer size
-                if (len >= MAX_LINE_LENGTH) {
-                    fprintf(stderr, "Error: Dimension value too large for buffer (size=%zu).\n", len);
-                    continue;
-                }
-                memcpy(f_lambda_str, start, len);
-                f_lambda_str[len] = '\0';
-            } else {
-                // If there's no space, just copy the rest of the line
-                // Create a temporary copy to handle the newline
-                char temp[MAX_LINE_LENGTH];
-                strncpy(temp, start, MAX_LINE_LENGTH - 1);
-                temp[MAX_LINE_LENGTH - 1] = '\0';
-
-                // Remove potential newline
-                char *newline = strchr(temp, '\n');
-                if (newline) *newline = '\0';
-
-                // Check length before copying
-                if (strlen(temp) >= MAX_LINE_LENGTH) {
-                    fprintf(stderr, "Error: Dimension value too large for buffer (size=%zu).\n", strlen(temp));
-                    continue;
-                }
-
-                strcpy(f_lambda_str, temp);
-            }
-
-            // Successfully extracted the dimension
+    int batch_capacity = (num_threads > 1) ? BLOCKS_PER_THREAD * num_threads : 1;
+    UpdateBlock *batch = (UpdateBlock *)malloc(batch_capacity * sizeof(UpdateBlock));
+    if (!batch) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return EXIT_FAILURE;
+    }
+    int batch_size = 0;
+
+    if (stream_file) {
+        if (!process_c_lambda_stream(root, stream_file, &txt_map, batch, batch_capacity, num_threads)) {
+            free(batch);
+            unmap_file(&txt_map);
+            json_object_free(root);
+            return EXIT_FAILURE;
         }
+        batch_size = 0;
+    } else {
+        char *cursor = txt_map.data;
+        char *data_end = txt_map.data + txt_map.size;
+        while (cursor < data_end) {
+            // One line: [line, line_end), found with memchr
+            char *line = cursor;
+            char *line_end = memchr(cursor, '\n', data_end - cursor);
+            if (!line_end) line_end = data_end;
+            cursor = line_end + 1;
+            size_t line_len = line_end - line;
+            if (line_len > 0 && line[line_len - 1] == '\r') line_len--;
+
+            // Check for size marker
+            if (line_has_prefix(line, line_len, "--- Size ")) {
+                // Extract n value
+                current_n = strtoul(line + 9, NULL, 10);
+                parsing_block = 1;
+
+                // Report progress
+                printf("Processing n=%lu...\n", current_n);
+
+                // Clear previous block data
+                f_lambda_start = NULL;
+                f_lambda_len = 0;
+            }
 
-        // Extract partitions
-        if (parsing_block && strstr(line, "Partitions achieving maximum: ")) {
-            // Parse the partition string
-            partition = parse_partition_string(line, &partition_size);
-
-            // We have all the data for this block, process it
-            if (current_n > 0 && f_lambda_str[0] != '\0' && partition) {
-                // Initialize GMP variables
-                mpz_init(current_f_lambda);
-                mpz_init(existing_f_lambda);
-
-                // Convert f_lambda string to mpz_t
-                if (mpz_set_str(current_f_lambda, f_lambda_str, 10) != 0) {
-                    fprintf(stderr, "Error: Invalid f^lambda value '%s'.\n", f_lambda_str);
-                    continue;
-                }
+            // Extract Max f^lambda (the value ends at the first space, else at the end of the line)
+            else if (parsing_block && line_has_prefix(line, line_len, "Max f^lambda: ")) {
+                f_lambda_start = line + 14;
+                char *space = memchr(f_lambda_start, ' ', line + line_len - f_lambda_start);
+                f_lambda_len = (space ? space : line + line_len) - f_lambda_start;
+            }
 
-                // Create key for JSON object
-                char n_str[32];
-                snprintf(n_str, sizeof(n_str), "%lu", current_n);
-
-                // Check if we need to update
-                int needs_update = 1;
-                PartitionEntry *existing_entry = json_object_get(root, n_str);
-
-                if (existing_entry && existing_entry->dimension) {
-                    // Convert existing dimension to mpz_t
-                    if (mpz_set_str(existing_f_lambda, existing_entry->dimension, 10) == 0) {
-                        // Compare dimensions
-                        if (mpz_cmp(current_f_lambda, existing_f_lambda) <= 0) {
-                            needs_update = 0;
-                            printf("Skipping n=%lu: keeping existing dimension\n", current_n);
-                        } else {
-                            printf("Found larger dimension for n=%lu\n", current_n);
-                        }
-                    } else {
-                        fprintf(stderr, "Error: Failed to parse existing dimension '%s', will update anyway.\n",
-                                existing_entry->dimension);
-                    }
+            // Extract partitions
+            else if (parsing_block && line_has_prefix(line, line_len, "Partitions achieving maximum: ")) {
+                // Parse the partition string
+                int partition_size = 0;
+                int *partition = parse_partition_range(line + 30, line + line_len, &partition_size);
+
+                // We have all the data for this block, queue it
+                if (current_n > 0 && f_lambda_len > 0 && partition) {
+                    // Terminate the digits in place: the mapping is private, so the file is untouched,
+                    // and the byte replaced (a space or the line end) has already been scanned
+                    UpdateBlock *block = &batch[batch_size];
+                    f_lambda_start[f_lambda_len] = '\0';
+                    block->n = current_n;
+                    block->f_lambda_str = f_lambda_start;
+                    block->partition = partition;
+                    block->partition_size = partition_size;
+                    block->has_c_lambda = 0;
+                    batch_size++;
+
+                    // Reset parsing state
+                    parsing_block = 0;
                 } else {
-                    printf("Adding new entry for n=%lu\n", current_n);
+                    free(partition);
                 }
 
-                // Update JSON if needed
-                if (needs_update) {
-                    // Calculate c_lambda
-                    mpf_t c_lambda_val;
-                    mpf_init(c_lambda_val);
-                    compute_c_lambda(c_lambda_val, current_f_lambda, current_n);
-
-                    // Create new entry
-                    PartitionEntry *new_entry = (PartitionEntry *)malloc(sizeof(PartitionEntry));
-                    if (!new_entry) {
-                        fprintf(stderr, "Error: Memory allocation failed.\n");
-                        continue;
-                    }
-
-                    // Set dimension - ensure the full value is captured without truncation
-                    char *dimension_str = mpz_get_str(NULL, 10, current_f_lambda);
-                    // Double-check to make sure we got the full dimension string
-                    if (dimension_str) {
-                        new_entry->dimension = dimension_str;
-                    } else {
-                        fprintf(stderr, "Error: Failed to convert dimension to string.\n");
-                        free(new_entry);
-                        continue;
-                    }
-
-                    // Copy partition array
-                    new_entry->partition = (int *)malloc(partition_size * sizeof(int));
-                    if (new_entry->partition) {
-                        memcpy(new_entry->partition, partition, partition_size * sizeof(int));
-                        new_entry->partition_size = partition_size;
-                    } else {
-                        new_entry->partition_size = 0;
-                    }
-
-                    // Set c_lambda
-                    new_entry->c_lambda = mpf_get_d(c_lambda_val);
-
-                    // Update JSON object
-                    json_object_set(root, n_str, new_entry);
-
-                    // Clean up
-                    mpf_clear(c_lambda_val);
-
-                    printf("Updated n=%lu: new dimension saved\n", current_n);
+                if (batch_size == batch_capacity) {
+                    process_batch(root, batch, batch_size, num_threads);
+                    batch_size = 0;
                 }
-
-                // Clean up GMP variables
-                mpz_clear(current_f_lambda);
-                mpz_clear(existing_f_lambda);
-
-                // Reset parsing state
-                parsing_block = 0;
             }
         }
     }
-
-    // Clean up any remaining partition array
-    if (partition) {
-        free(partition);
+    if (batch_size > 0) {
+        process_batch(root, batch, batch_size, num_threads);
     }
+    free(batch);
+
+    unmap_file(&txt_map);
 
     // Write updated JSON to file
     if (!json_dump_file(root, output_json_file)) {
         fprintf(stderr, "Error: Failed to write JSON to file '%s'.\n", output_json_file);
         json_object_free(root);
-        fclose(txt_file);
+        return EXIT_FAILURE;
+    }
+
+    if (c_lambda_mode == C_LAMBDA_VERIFY) {
+        printf("c(lambda) verification: %lu entries, %lu mismatches, max |exact - fast| = %.3g\n",
+               c_lambda_verified, c_lambda_mismatches, c_lambda_max_diff);
+    }
+
+    if (analytics_file && !write_shape_analytics(root, analytics_file, num_threads)) {
+        fprintf(stderr, "Error: Failed to write shape analytics to '%s'.\n", analytics_file);
+        json_object_free(root);
         return EXIT_FAILURE;
     }
 
     // Clean up
     json_object_free(root);
-    fclose(txt_file);
 
     printf("Successfully completed: results written to '%s'.\n", output_json_file);
     return EXIT_SUCCESS;